@@ -1,3 +1,4 @@
+import os
 import matplotlib.pyplot as plt
 import pandas as pd
 import seaborn as sns
@@ -10,6 +11,12 @@ def read_statistics():
         print("Error: memory_stats.txt not found. Run the C program first to generate statistics.")
         exit()
 
+def read_timeseries():
+    # Written by --sample-every / --sample-ms during a replay; optional
+    if not os.path.exists('memory_timeseries.csv'):
+        return None
+    return pd.read_csv('memory_timeseries.csv')
+
 def plot_memory_utilization(df):
     plt.figure(figsize=(12, 6))
     ax = sns.barplot(x='Memory Management Technique', y='Allocated', data=df)
@@ -44,6 +51,23 @@ def plot_fragmentation(df):
     plt.savefig('fragmentation.png')
     plt.show()
 
+def plot_internal_fragmentation(df):
+    plt.figure(figsize=(12, 6))
+    ax = sns.barplot(x='Memory Management Technique', y='InternalFragmentation', data=df)
+    plt.title('Internal Fragmentation by Technique')
+    plt.ylabel('Internal Fragmentation (% of allocated)')
+    plt.xticks(rotation=45)
+    
+    # Add values on top of bars
+    for p in ax.patches:
+        ax.annotate(f"{p.get_height():.1f}%", 
+                    (p.get_x() + p.get_width() / 2., p.get_height()),
+                    ha='center', va='center', xytext=(0, 10), textcoords='offset points')
+    
+    plt.tight_layout()
+    plt.savefig('internal_fragmentation.png')
+    plt.show()
+
 def plot_success_rate(df):
     plt.figure(figsize=(12, 6))
     ax = sns.barplot(x='Memory Management Technique', y='SuccessRate', data=df)
@@ -89,6 +113,26 @@ def plot_comparison(df):
     plt.savefig('memory_comparison.png')
     plt.show()
 
+def plot_timeseries(ts):
+    fig, axes = plt.subplots(3, 1, figsize=(12, 15), sharex=True)
+
+    sns.lineplot(ax=axes[0], x='Operation', y='Fragmentation', hue='Technique', data=ts)
+    axes[0].set_title('Fragmentation over Time')
+    axes[0].set_ylabel('Fragmentation (%)')
+
+    sns.lineplot(ax=axes[1], x='Operation', y='SuccessRate', hue='Technique', data=ts)
+    axes[1].set_title('Success Rate over Time')
+    axes[1].set_ylabel('Success Rate (%)')
+
+    sns.lineplot(ax=axes[2], x='Operation', y='Allocated', hue='Technique', data=ts)
+    axes[2].set_title('Memory Utilization over Time')
+    axes[2].set_ylabel('Allocated (bytes)')
+    axes[2].set_xlabel('Operations')
+
+    plt.tight_layout()
+    plt.savefig('memory_timeseries.png')
+    plt.show()
+
 def main():
     # Read the statistics data
     df = read_statistics()
@@ -99,8 +143,15 @@ def main():
     print("\nGenerating visualizations...")
     plot_memory_utilization(df)
     plot_fragmentation(df)
+    # Older statistics files predate the column
+    if 'InternalFragmentation' in df.columns:
+        plot_internal_fragmentation(df)
     plot_success_rate(df)
     plot_comparison(df)
+
+    ts = read_timeseries()
+    if ts is not None:
+        plot_timeseries(ts)
     print("Visualizations saved as PNG files.")
 
 if __name__ == "__main__":
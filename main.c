@@ -1,422 +1,5577 @@
+// Build: gcc -O2 -pthread main.c -o main -lm
+#define _POSIX_C_SOURCE 200809L // pread, strdup, clock_gettime
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define MEMORY_SIZE 1000
-#define MAX_BLOCKS 20
-#define ALGORITHMS 4
-#define FRAG_THRESHOLD 5
-#define PAGE_SIZE 50
-#define MAX_PROCESSES 10
+#define BLOCK_POOL_INITIAL 64
+#define ALGORITHMS 6
+#define BUDDY_SYSTEM 4 // Indices of the algorithms with their own split/merge rules
+#define TLSF_ALLOCATOR 5
+#define TLSF_SL_LOG2 3
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT 61 // Enough first-level classes for any positive 64-bit size
+#define FREE_HISTOGRAM_BUCKETS 64
+#define MAX_SIZE_CLASS_TABLE 64
+#define TLB_HIT_CYCLES 1
+#define MEMORY_ACCESS_CYCLES 100
+#define HUGE_MIN_USE_PERCENT 50 // A tail this full of a huge page is rounded up to one
+#define EMPTY_KEY UINT64_MAX
+#define PENDING_OWNER -4 // processID of blocks released by a bulk free but not yet coalesced
 
+// Open-addressing map from a 64-bit key (a page key, or a process ID) to a long.
 typedef struct {
-    int start;
-    int size;
+    uint64_t *keys;
+    long *values;
+    long capacity;
+    long count;
+} KeyMap;
+
+typedef struct {
+    long start;
+    long size;
     bool allocated;
+    uint8_t alignShift; // log2 of the alignment an allocated block was placed with
     int processID;
+    int prev; // Neighbours in address order, -1 at either end
+    int next;
+    int addrLeft; // Free-block index links, see indexFreeBlock()
+    int addrRight;
+    int sizeLeft;
+    int sizeRight;
+    long maxFree;
+    unsigned priority;
+    int freePrev; // TLSF segregated list links
+    int freeNext;
+    int ownerPrev; // Allocated blocks of the same process, see ownerLink()
+    int ownerNext;
+    long requested; // Units asked for; the rest of an allocated block is internal fragmentation
 } Block;
 
+// Blocks live in a growable pool and are linked in address order by index, so
+// splitting and coalescing relink neighbours instead of shifting an array.
+typedef struct {
+    int algorithm;
+    long arenaSize;
+    Block *memory;
+    int capacity;
+    int freeSlots; // Recycled pool entries, chained through next
+    int head;
+    int totalBlocks;
+    int lastAlloc;
+    bool indexed; // Keep the free-block index and use it in the fit functions
+    int addrRoot;
+    int sizeRoot;
+    unsigned treapSeed;
+    uint64_t tlsfFirstMap;
+    unsigned tlsfSecondMap[TLSF_FL_COUNT];
+    int tlsfHeads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    int successfulAllocations;
+    int failedAllocations;
+    int totalRequests;
+    long freeBytes; // Free-space counters, kept by indexFreeBlock()/unindexFreeBlock()
+    int freeBlocks;
+    long fragmentedBytes; // In free blocks of at most fragThreshold
+    int smallFragments;
+    int freeHistogram[FREE_HISTOGRAM_BUCKETS]; // Free blocks by floor(log2(size))
+    long internalBytes; // Allocated beyond the requests: size-class and buddy rounding
+    KeyMap owners; // processID -> first block on its ownership list
+    long compactions; // Compaction steps that moved at least one block
+    long bytesMoved;
+    uint64_t compactionNanos;
+    int compactionRescues; // Allocations that only succeeded after compacting
+} MemoryManager;
+
+typedef enum { COMPACT_OFF, COMPACT_FULL, COMPACT_INCREMENTAL, COMPACT_BUDGETED } CompactionMode;
+typedef enum { HUGE_NEVER, HUGE_ALWAYS, HUGE_DEFER } HugePageMode;
+typedef enum { NUMA_LOCAL, NUMA_INTERLEAVE, NUMA_PREFERRED } NumaPolicy;
+
+#define MAX_NUMA_NODES 8
+#define NUMA_LOCAL_DISTANCE 10 // ACPI SLIT convention: distances relative to 10 for local
+
+typedef struct {
+    MemoryManager nodes[MAX_NUMA_NODES]; // One arena per node, all with the same fit policy
+    int nextInterleave;
+    long requests;
+    long successes;
+    long fallbacks; // Placed on a node other than the policy's first choice
+    long localBytes;
+    long remoteBytes;
+    long weightedCost; // Sum of size x distance from the process's home node
+} NumaArena;
+
+#define SEGMENT_KINDS 4
+#define SEG_READ 1 // Segment protection bits
+#define SEG_WRITE 2
+#define SEG_EXEC 4
+
+enum { SEG_CODE, SEG_DATA, SEG_STACK, SEG_HEAP };
+
+typedef struct {
+    int block; // Handle in segmentArena, -1 while the segment does not exist
+    long limit; // Addressable bytes, 0 while the segment does not exist
+    int protection;
+    int pageTableRoot; // With paged segments: the segment's own page table
+    int pageCount;
+} Segment;
+
+typedef struct {
+    int pageTableRoot; // Radix page table, -1 until the first page is mapped
+    int pageCount;
+    int mappedPages; // Pages backed by frames; past pageCount when a huge page was rounded up
+    long size;
+    int processID;
+    Segment segments[SEGMENT_KINDS];
+} Process;
+
+#define FRAME_BITMAP_LEVELS 6
+
+typedef struct {
+    bool valid;
+    int processID;
+    int vpn; // For a huge page, vpn >> (pageLevel * pageTableBits)
+    int pageLevel; // 0 for a base page, else the page-table level of a huge mapping
+    int frame;
+    unsigned long lastUse;
+} TlbEntry;
+
+typedef struct {
+    uint64_t *levels[FRAME_BITMAP_LEVELS];
+    int words[FRAME_BITMAP_LEVELS];
+    int levelCount;
+    int frames;
+    int freeFrames;
+    int readyWords; // Level-0 words written so far; the rest are implicitly all free
+} FrameBitmap;
+
+#define REPLACEMENT_POLICIES 6
+#define POLICY_LISTS 4
+#define LIST_T1 0
+#define LIST_T2 1
+#define LIST_B1 2
+#define LIST_B2 3
+#define REFERENCE_REMOVED (1ull << 63) // Marks a page dropped from the reference string
+
+enum { POLICY_FIFO, POLICY_LRU, POLICY_CLOCK, POLICY_ARC, POLICY_2Q, POLICY_OPT };
+
+typedef struct {
+    uint64_t key;
+    int prev;
+    int next;
+    int list;
+    bool referenced;
+} PageNode;
+
+typedef struct {
+    int policy;
+    int capacity; // Frames
+    int resident;
+    PageNode *nodes;
+    int nodeCapacity;
+    int nodeCount;
+    int freeNodes;
+    KeyMap index; // Page key -> node
+    int head[POLICY_LISTS];
+    int tail[POLICY_LISTS];
+    int size[POLICY_LISTS];
+    int clockHand;
+    int arcTarget;
+    long hits;
+    long faults;
+} ReplacementState;
+
+typedef struct {
+    long nextUse;
+    uint64_t key;
+} OptHeapEntry;
+
+MemoryManager managers[ALGORITHMS];
+const char* algorithmNames[ALGORITHMS] = {"First Fit", "Best Fit", "Worst Fit", "Next Fit", "Buddy", "TLSF"};
+long memorySize = 1000; // Units in every arena and in physical memory, see --memory
+int maxProcesses = 10;
+int fragThreshold = 5; // Free blocks this small or smaller count as fragments
+Process *processes; // maxProcesses entries
+int nextProcessID = 1;
+FrameBitmap frameMap; // Tracks which frames are free
+int pageSize = 50;
+int pageTableLevels = 2;
+int pageTableBits = 4; // Index bits per page-table level
+int *ptEntries; // Page-table node pool, see pageTableSlot()
+int ptNodeCapacity;
+int ptNodeCount;
+int ptNodesInUse;
+int ptFreeNodes = -1;
+TlbEntry *tlb;
+int tlbSets = 4;
+int tlbWays = 4;
+unsigned long tlbClock;
+long translations, tlbHits, tlbMisses, tlbEvictions, translationFaults;
+long pageWalks, walkReferences, translationCycles;
+bool contiguousPages = false; // Prefer one run of frames over the lowest free frames
+HugePageMode hugePageMode = HUGE_NEVER;
+const char* hugePageModeNames[] = {"never", "always", "defer"};
+int numaNodes; // 0 unless --numa; then every fit policy also runs on that many node arenas
+NumaPolicy numaPolicy = NUMA_LOCAL;
+const char* numaPolicyNames[] = {"local", "interleave", "preferred"};
+int numaPreferredNode;
+int numaDistance[MAX_NUMA_NODES][MAX_NUMA_NODES];
+NumaArena numaArenas[ALGORITHMS];
+int hugePageLevel = 1; // Largest page-table level whose entries may map a huge page
+long hugePromotions, hugePromotionsInPlace, hugeBytesCopied, hugeDemotions, hugeFallbacks;
+MemoryManager segmentArena; // Segments have their own arena and placement policy
+const char* segmentNames[SEGMENT_KINDS] = {"Code", "Data", "Stack", "Heap"};
+const int segmentProtection[SEGMENT_KINDS] = {SEG_READ | SEG_EXEC, SEG_READ | SEG_WRITE,
+                                              SEG_READ | SEG_WRITE, SEG_READ | SEG_WRITE};
+int segmentPolicy = 0; // Index into fitFunctions
+long segmentGrowthsInPlace, segmentRelocations, segmentBytesCopied;
+long segmentTranslations, segmentFaults, protectionFaults;
+long segmentWalkReferences, segmentCycles;
+bool pagedSegments = false; // Back segments with page tables over the frame pool instead of segmentArena
+long pagedSegmentRequests, pagedSegmentSuccesses;
+bool demandPaging = false; // Reserve virtual pages and fault frames in on first use
+const char* replacementNames[REPLACEMENT_POLICIES] = {"FIFO", "LRU", "CLOCK", "ARC", "2Q", "OPT"};
+ReplacementState pagingPolicy; // Chooses the victims under demand paging
+ReplacementState shadowPolicies[REPLACEMENT_POLICIES]; // Every policy on the same references
+FrameBitmap swapMap; // Simulated swap device, one slot per page
+int swapPages; // 0 sizes the device at four times physical memory
+uint64_t *pageReferences; // Reference string for OPT
+long referenceCount, referenceCapacity;
+long optimalReferences = -1; // referenceCount the OPT counts were last simulated at
+bool referencesDropped; // The string could not grow, so OPT cannot be simulated
+long pageFaults, zeroFills, swapIns, swapOuts, outOfMemoryFaults;
+bool verbose = true; // Per-operation output; batch mode turns this off
+bool useFreeIndex = true;
+CompactionMode compactionMode = COMPACT_OFF;
+const char* compactionNames[] = {"off", "full", "incremental", "budgeted"};
+long compactionBudget; // Bytes moved per step in COMPACT_BUDGETED
+float compactionThreshold; // Fragmentation % that triggers a step after a free; 0 = only on failure
+long requestAlignment = 1; // Default alignment of block requests, a power of two
+long sizeClassTable[MAX_SIZE_CLASS_TABLE]; // Ascending; requests round up to the first class that holds them
+int sizeClassCount; // 0 keeps requests at their exact size
+char *snapshotBase; // Private mapping of a restored snapshot, see restoreSnapshot()
+size_t snapshotSize;
+
+// Metadata arena: the simulator's growable arrays (block pools, page-table
+// nodes, ownership maps, policy lists, stats buffers) all come from here.
+// Requests are rounded up to a power of two and bump-allocated from
+// META_CHUNK_SIZE chunks, and freed arrays wait on a free list per size for
+// reuse, so once the pools reach their working size a replay makes no system
+// allocations at all; nothing is handed back to the system. Each array starts
+// with a META_HEADER holding its size class, so frees need no size.
+#define META_CHUNK_SIZE (1 << 20)
+#define META_HEADER 16 // Keeps the arrays 16-byte aligned
+#define META_CLASSES 48
+#define META_LARGE (META_CHUNK_SIZE / 4) // Larger arrays get a system allocation of their own
+
+typedef struct {
+    pthread_mutex_t lock; // Sweep and concurrent-bench threads grow arenas too
+    char *bump;
+    size_t bumpLeft;
+    char *freeLists[META_CLASSES]; // Chained through the header
+    long requests;
+    long reused;
+    long systemAllocations;
+    long systemBytes;
+} MetaArena;
+
+MetaArena meta = {.lock = PTHREAD_MUTEX_INITIALIZER};
+_Thread_local long threadSystemAllocations; // The calling thread's share, for the benchmarks
+
+void *allocArray(size_t bytes) {
+    int sizeClass = 5;
+    while (((size_t)1 << sizeClass) < bytes + META_HEADER) sizeClass++;
+    size_t size = (size_t)1 << sizeClass;
+    pthread_mutex_lock(&meta.lock);
+    meta.requests++;
+    char *p = meta.freeLists[sizeClass];
+    if (p) {
+        meta.freeLists[sizeClass] = *(char **)p;
+        meta.reused++;
+    } else if (size <= META_LARGE && size <= meta.bumpLeft) {
+        p = meta.bump;
+        meta.bump += size;
+        meta.bumpLeft -= size;
+    } else {
+        size_t chunk = size > META_LARGE ? size : META_CHUNK_SIZE;
+        p = malloc(chunk);
+        if (p) {
+            meta.systemAllocations++;
+            meta.systemBytes += chunk;
+            threadSystemAllocations++;
+            if (chunk > size) {
+                meta.bump = p + size;
+                meta.bumpLeft = chunk - size;
+            }
+        }
+    }
+    pthread_mutex_unlock(&meta.lock);
+    if (!p) return NULL;
+    *(int *)p = sizeClass;
+    return p + META_HEADER;
+}
+
+// Arrays restored from a snapshot point into its copy-on-write mapping, so the
+// first time one of them has to grow it is copied out instead.
+bool inSnapshot(const void *p) {
+    return snapshotBase && (const char *)p >= snapshotBase && (const char *)p < snapshotBase + snapshotSize;
+}
+
+void freeArray(void *p) {
+    if (!p || inSnapshot(p)) return;
+    char *header = (char *)p - META_HEADER;
+    int sizeClass = *(int *)header;
+    pthread_mutex_lock(&meta.lock);
+    *(char **)header = meta.freeLists[sizeClass];
+    meta.freeLists[sizeClass] = header;
+    pthread_mutex_unlock(&meta.lock);
+}
+
+void *resizeArray(void *p, size_t oldBytes, size_t newBytes) {
+    if (p && !inSnapshot(p) && newBytes + META_HEADER <= (size_t)1 << *(int *)((char *)p - META_HEADER)) {
+        return p;
+    }
+    void *copy = allocArray(newBytes);
+    if (copy && p) memcpy(copy, p, oldBytes < newBytes ? oldBytes : newBytes);
+    if (copy) freeArray(p);
+    return copy;
+}
+
+void showMetaArenaStats(long systemAllocationsBefore) {
+    printf("Metadata arena: %ld system allocations (%ld KB), %ld array requests (%ld reused); "
+           "%ld system allocations during the run\n",
+           meta.systemAllocations, meta.systemBytes / 1024, meta.requests, meta.reused,
+           meta.systemAllocations - systemAllocationsBefore);
+}
+
+// Takes an entry from the block pool, growing it when the recycled list is empty.
+int newBlock(MemoryManager *m) {
+    if (m->freeSlots == -1) {
+        int capacity = m->capacity ? m->capacity * 2 : BLOCK_POOL_INITIAL;
+        Block *memory = resizeArray(m->memory, m->capacity * sizeof(Block), capacity * sizeof(Block));
+        if (!memory) {
+            return -1;
+        }
+        for (int i = capacity - 1; i >= m->capacity; i--) {
+            memory[i].next = m->freeSlots;
+            m->freeSlots = i;
+        }
+        m->memory = memory;
+        m->capacity = capacity;
+    }
+    int index = m->freeSlots;
+    m->freeSlots = m->memory[index].next;
+    m->totalBlocks++;
+    return index;
+}
+
+void releaseBlock(MemoryManager *m, int index) {
+    m->memory[index].next = m->freeSlots;
+    m->freeSlots = index;
+    m->totalBlocks--;
+}
+
+// TLSF segregated lists: the first level splits sizes by power of two and the
+// second level divides each power of two into TLSF_SL_COUNT linear classes.
+// Sizes below TLSF_SL_COUNT all map to first level 0.
+void tlsfMapping(long size, int *fl, int *sl) {
+    if (size < TLSF_SL_COUNT) {
+        *fl = 0;
+        *sl = (int)size;
+        return;
+    }
+    int log2 = 63 - __builtin_clzl(size);
+    *fl = log2 - TLSF_SL_LOG2 + 1;
+    *sl = (int)(size >> (log2 - TLSF_SL_LOG2)) - TLSF_SL_COUNT;
+}
+
+void tlsfInsert(MemoryManager *m, int index) {
+    int fl, sl;
+    tlsfMapping(m->memory[index].size, &fl, &sl);
+    int head = m->tlsfHeads[fl][sl];
+    m->memory[index].freePrev = -1;
+    m->memory[index].freeNext = head;
+    if (head != -1) {
+        m->memory[head].freePrev = index;
+    }
+    m->tlsfHeads[fl][sl] = index;
+    m->tlsfFirstMap |= 1ull << fl;
+    m->tlsfSecondMap[fl] |= 1u << sl;
+}
+
+void tlsfRemove(MemoryManager *m, int index) {
+    int fl, sl;
+    tlsfMapping(m->memory[index].size, &fl, &sl);
+    Block *b = &m->memory[index];
+    if (b->freePrev != -1) {
+        m->memory[b->freePrev].freeNext = b->freeNext;
+    } else {
+        m->tlsfHeads[fl][sl] = b->freeNext;
+    }
+    if (b->freeNext != -1) {
+        m->memory[b->freeNext].freePrev = b->freePrev;
+    }
+    if (m->tlsfHeads[fl][sl] == -1) {
+        m->tlsfSecondMap[fl] &= ~(1u << sl);
+        if (!m->tlsfSecondMap[fl]) {
+            m->tlsfFirstMap &= ~(1ull << fl);
+        }
+    }
+}
+
+// Free-block index: two treaps over the free blocks only, sharing one priority.
+// The address treap is augmented with the largest free size in each subtree so
+// First/Next Fit can skip ranges that cannot fit; the size treap is ordered by
+// (size, start) so Best/Worst Fit find the same block the linear scans pick.
+unsigned treapPriority(MemoryManager *m) {
+    m->treapSeed ^= m->treapSeed << 13;
+    m->treapSeed ^= m->treapSeed >> 17;
+    m->treapSeed ^= m->treapSeed << 5;
+    return m->treapSeed;
+}
+
+void addrUpdate(MemoryManager *m, int t) {
+    Block *b = &m->memory[t];
+    b->maxFree = b->size;
+    if (b->addrLeft != -1 && m->memory[b->addrLeft].maxFree > b->maxFree) {
+        b->maxFree = m->memory[b->addrLeft].maxFree;
+    }
+    if (b->addrRight != -1 && m->memory[b->addrRight].maxFree > b->maxFree) {
+        b->maxFree = m->memory[b->addrRight].maxFree;
+    }
+}
+
+int addrMerge(MemoryManager *m, int a, int b) {
+    if (a == -1) return b;
+    if (b == -1) return a;
+    if (m->memory[a].priority > m->memory[b].priority) {
+        m->memory[a].addrRight = addrMerge(m, m->memory[a].addrRight, b);
+        addrUpdate(m, a);
+        return a;
+    }
+    m->memory[b].addrLeft = addrMerge(m, a, m->memory[b].addrLeft);
+    addrUpdate(m, b);
+    return b;
+}
+
+// Splits t into blocks starting before start (*l) and the rest (*r).
+void addrSplit(MemoryManager *m, int t, long start, int *l, int *r) {
+    if (t == -1) {
+        *l = *r = -1;
+    } else if (m->memory[t].start < start) {
+        addrSplit(m, m->memory[t].addrRight, start, &m->memory[t].addrRight, r);
+        addrUpdate(m, t);
+        *l = t;
+    } else {
+        addrSplit(m, m->memory[t].addrLeft, start, l, &m->memory[t].addrLeft);
+        addrUpdate(m, t);
+        *r = t;
+    }
+}
+
+bool sizeLess(MemoryManager *m, int a, long size, long start) {
+    return m->memory[a].size < size || (m->memory[a].size == size && m->memory[a].start < start);
+}
+
+int sizeMerge(MemoryManager *m, int a, int b) {
+    if (a == -1) return b;
+    if (b == -1) return a;
+    if (m->memory[a].priority > m->memory[b].priority) {
+        m->memory[a].sizeRight = sizeMerge(m, m->memory[a].sizeRight, b);
+        return a;
+    }
+    m->memory[b].sizeLeft = sizeMerge(m, a, m->memory[b].sizeLeft);
+    return b;
+}
+
+// Splits t into blocks ordered before (size, start) (*l) and the rest (*r).
+void sizeSplit(MemoryManager *m, int t, long size, long start, int *l, int *r) {
+    if (t == -1) {
+        *l = *r = -1;
+    } else if (sizeLess(m, t, size, start)) {
+        sizeSplit(m, m->memory[t].sizeRight, size, start, &m->memory[t].sizeRight, r);
+        *l = t;
+    } else {
+        sizeSplit(m, m->memory[t].sizeLeft, size, start, l, &m->memory[t].sizeLeft);
+        *r = t;
+    }
+}
+
+// Adds (delta 1) or removes (delta -1) a free block from the usage counters.
+void countFreeBlock(MemoryManager *m, long size, int delta) {
+    m->freeBytes += delta * size;
+    m->freeBlocks += delta;
+    m->freeHistogram[63 - __builtin_clzl(size)] += delta;
+    if (size <= fragThreshold) {
+        m->fragmentedBytes += delta * size;
+        m->smallFragments += delta;
+    }
+}
+
+// Must be called whenever a block becomes free, before anything else reads the index.
+void indexFreeBlock(MemoryManager *m, int index) {
+    countFreeBlock(m, m->memory[index].size, 1);
+    if (m->algorithm == TLSF_ALLOCATOR) tlsfInsert(m, index);
+    if (!m->indexed) return;
+    Block *b = &m->memory[index];
+    int l, r;
+    b->priority = treapPriority(m);
+    b->addrLeft = b->addrRight = -1;
+    b->sizeLeft = b->sizeRight = -1;
+    b->maxFree = b->size;
+
+    addrSplit(m, m->addrRoot, b->start, &l, &r);
+    m->addrRoot = addrMerge(m, addrMerge(m, l, index), r);
+    sizeSplit(m, m->sizeRoot, b->size, b->start, &l, &r);
+    m->sizeRoot = sizeMerge(m, sizeMerge(m, l, index), r);
+}
+
+// Must be called while a free block still has the start and size it was indexed with.
+void unindexFreeBlock(MemoryManager *m, int index) {
+    countFreeBlock(m, m->memory[index].size, -1);
+    if (m->algorithm == TLSF_ALLOCATOR) tlsfRemove(m, index);
+    if (!m->indexed) return;
+    Block *b = &m->memory[index];
+    int l, mid, r;
+
+    addrSplit(m, m->addrRoot, b->start, &l, &r);
+    addrSplit(m, r, b->start + 1, &mid, &r);
+    m->addrRoot = addrMerge(m, l, r);
+    sizeSplit(m, m->sizeRoot, b->size, b->start, &l, &r);
+    sizeSplit(m, r, b->size, b->start + 1, &mid, &r);
+    m->sizeRoot = sizeMerge(m, l, r);
+}
+
+// Lowest-addressed free block of at least size in the subtree, starting at from.
+int addrFirstFit(MemoryManager *m, int t, long size, long from) {
+    while (t != -1 && m->memory[t].maxFree >= size) {
+        Block *b = &m->memory[t];
+        if (b->start < from) {
+            t = b->addrRight;
+            continue;
+        }
+        int found = addrFirstFit(m, b->addrLeft, size, from);
+        if (found != -1) return found;
+        if (b->size >= size) return t;
+        t = b->addrRight;
+    }
+    return -1;
+}
+
+// Smallest (size, start) not below the given key.
+int sizeLowerBound(MemoryManager *m, long size) {
+    int found = -1;
+    for (int t = m->sizeRoot; t != -1; ) {
+        if (m->memory[t].size >= size) {
+            found = t;
+            t = m->memory[t].sizeLeft;
+        } else {
+            t = m->memory[t].sizeRight;
+        }
+    }
+    return found;
+}
+
+int largestFreeBlock(MemoryManager *m) {
+    int t = m->sizeRoot;
+    while (t != -1 && m->memory[t].sizeRight != -1) {
+        t = m->memory[t].sizeRight;
+    }
+    return t;
+}
+
+// Cuts a block after its first size units; returns the new remainder block or -1.
+int splitBlock(MemoryManager *m, int index, long size) {
+    int rest = newBlock(m);
+    if (rest == -1) {
+        return -1;
+    }
+    Block *b = &m->memory[index];
+    Block *r = &m->memory[rest];
+    r->start = b->start + size;
+    r->size = b->size - size;
+    r->allocated = false;
+    r->processID = -1;
+    r->prev = index;
+    r->next = b->next;
+    if (b->next != -1) {
+        m->memory[b->next].prev = rest;
+    }
+    b->next = rest;
+    b->size = size;
+    return rest;
+}
+
+// Absorbs the block following index into it.
+void mergeWithNext(MemoryManager *m, int index) {
+    Block *b = &m->memory[index];
+    int next = b->next;
+    b->size += m->memory[next].size;
+    b->next = m->memory[next].next;
+    if (b->next != -1) {
+        m->memory[b->next].prev = index;
+    }
+    if (m->lastAlloc == next) {
+        m->lastAlloc = index;
+    }
+    releaseBlock(m, next);
+}
+
+// Free frames as a hierarchical bitmap: bit i of level 0 is set while frame i
+// is free, and every higher level has one bit per non-zero word of the level
+// below, so the lowest free frame is one ctz per level and claiming or
+// releasing a frame touches at most one word per level. Level 0 is filled in
+// lazily as frames are claimed, so a huge arena costs nothing until it is used.
+// Returns false, leaving an empty bitmap, if a level cannot be allocated.
+bool frameBitmapInit(FrameBitmap *fb, int frames) {
+    for (int l = 0; l < fb->levelCount; l++) {
+        freeArray(fb->levels[l]);
+    }
+    fb->frames = frames;
+    fb->freeFrames = frames;
+    fb->levelCount = 0;
+    fb->readyWords = 0;
+    int bits = frames;
+    do {
+        int words = (int)(((long)bits + 63) / 64);
+        uint64_t *level = allocArray((words ? words : 1) * sizeof(uint64_t));
+        if (!level) {
+            for (int l = 0; l < fb->levelCount; l++) {
+                freeArray(fb->levels[l]);
+            }
+            fb->levelCount = 0;
+            fb->frames = fb->freeFrames = 0;
+            return false;
+        }
+        level[0] = 0;
+        for (int w = 0; w < words && fb->levelCount > 0; w++) {
+            int valid = bits - w * 64;
+            level[w] = valid >= 64 ? ~0ull : (1ull << valid) - 1;
+        }
+        fb->levels[fb->levelCount] = level;
+        fb->words[fb->levelCount] = words;
+        fb->levelCount++;
+        bits = words;
+    } while (bits > 1);
+    return true;
+}
+
+uint64_t bitmapWord(const FrameBitmap *fb, int level, int w) {
+    if (level > 0 || w < fb->readyWords) return fb->levels[level][w];
+    int valid = fb->frames - w * 64;
+    return valid >= 64 ? ~0ull : (1ull << valid) - 1;
+}
+
+void prepareFrameWords(FrameBitmap *fb, int words) {
+    for (; fb->readyWords < words; fb->readyWords++) {
+        fb->levels[0][fb->readyWords] = bitmapWord(fb, 0, fb->readyWords);
+    }
+}
+
+bool frameIsFree(const FrameBitmap *fb, int frame) {
+    return bitmapWord(fb, 0, frame / 64) >> (frame % 64) & 1;
+}
+
+void claimFrameBit(FrameBitmap *fb, int frame) {
+    prepareFrameWords(fb, frame / 64 + 1);
+    int index = frame;
+    for (int l = 0; l < fb->levelCount; l++) {
+        uint64_t *word = &fb->levels[l][index / 64];
+        *word &= ~(1ull << (index % 64));
+        if (*word) break;
+        index /= 64;
+    }
+    fb->freeFrames--;
+}
+
+void releaseFrameBit(FrameBitmap *fb, int frame) {
+    prepareFrameWords(fb, frame / 64 + 1);
+    int index = frame;
+    for (int l = 0; l < fb->levelCount; l++) {
+        uint64_t *word = &fb->levels[l][index / 64];
+        bool wasEmpty = *word == 0;
+        *word |= 1ull << (index % 64);
+        if (!wasEmpty) break;
+        index /= 64;
+    }
+    fb->freeFrames++;
+}
+
+// Lowest set bit at or after from on the given level, or -1.
+int nextSetBit(const FrameBitmap *fb, int level, int from) {
+    int w = from / 64;
+    if (w >= fb->words[level]) return -1;
+    uint64_t bits = bitmapWord(fb, level, w) & (~0ull << (from % 64));
+    if (bits) return w * 64 + __builtin_ctzll(bits);
+    if (level + 1 == fb->levelCount) return -1;
+    int next = nextSetBit(fb, level + 1, w + 1);
+    if (next == -1) return -1;
+    return next * 64 + __builtin_ctzll(bitmapWord(fb, level, next));
+}
+
+int nextFreeFrame(const FrameBitmap *fb, int from) {
+    return nextSetBit(fb, 0, from);
+}
+
+// First allocated frame at or after from (fb->frames if the rest is free).
+int freeRunEnd(const FrameBitmap *fb, int from) {
+    for (int w = from / 64; w < fb->readyWords; w++) {
+        uint64_t used = ~fb->levels[0][w];
+        if (w == from / 64) used &= ~0ull << (from % 64);
+        if (used) {
+            int frame = w * 64 + __builtin_ctzll(used);
+            return frame < fb->frames ? frame : fb->frames;
+        }
+    }
+    return fb->frames;
+}
+
+// Start of the lowest run of count free frames, or -1; skips whole used and
+// free extents a word at a time.
+int findFreeRun(const FrameBitmap *fb, int count) {
+    for (int start = nextFreeFrame(fb, 0); start != -1; ) {
+        int end = freeRunEnd(fb, start);
+        if (end - start >= count) return start;
+        start = end < fb->frames ? nextFreeFrame(fb, end) : -1;
+    }
+    return -1;
+}
+
+// Like findFreeRun(), but the run must start on a multiple of align.
+int findAlignedFreeRun(const FrameBitmap *fb, int count, int align) {
+    for (int start = nextFreeFrame(fb, 0); start != -1; ) {
+        int end = freeRunEnd(fb, start);
+        int aligned = (start + align - 1) / align * align;
+        if (end - aligned >= count) return aligned;
+        start = end < fb->frames ? nextFreeFrame(fb, end) : -1;
+    }
+    return -1;
+}
+
+// Radix page tables. Every node has 2^pageTableBits entries and lives in one
+// pool; interior entries hold a child node and leaf entries a frame, with -1
+// for anything not mapped. Nodes are only created for ranges that get mapped.
+// An interior entry at level L may instead map a huge page directly: it holds
+// -2 - first frame of an aligned run of 2^(L * pageTableBits) frames.
+int pageTableFanout() {
+    return 1 << pageTableBits;
+}
+
+long maxVirtualPages() {
+    return 1L << (pageTableLevels * pageTableBits);
+}
+
+int newPageTableNode() {
+    int fanout = pageTableFanout();
+    int node = ptFreeNodes;
+    if (node != -1) {
+        ptFreeNodes = ptEntries[(long)node * fanout];
+    } else {
+        if (ptNodeCount == ptNodeCapacity) {
+            int capacity = ptNodeCapacity ? ptNodeCapacity * 2 : 64;
+            int *entries = resizeArray(ptEntries, (long)ptNodeCapacity * fanout * sizeof(int),
+                                       (long)capacity * fanout * sizeof(int));
+            if (!entries) return -1;
+            ptEntries = entries;
+            ptNodeCapacity = capacity;
+        }
+        node = ptNodeCount++;
+    }
+    for (int i = 0; i < fanout; i++) {
+        ptEntries[(long)node * fanout + i] = -1;
+    }
+    ptNodesInUse++;
+    return node;
+}
+
+void freePageTableNode(int node) {
+    ptEntries[(long)node * pageTableFanout()] = ptFreeNodes;
+    ptFreeNodes = node;
+    ptNodesInUse--;
+}
+
+int hugePageSpan(int level) {
+    return 1 << (level * pageTableBits);
+}
+
+// Index of the entry for vpn at level stop (0 for the leaf) in the table at
+// *root, or -1 if a level is missing and create is false (or a node could not
+// be allocated). A walk that meets a huge page above stop ends at its entry;
+// *level gets the level of the returned entry. Counts one reference per level.
+long walkPageTableTo(int *root, int vpn, int stop, bool create, int *references, int *level) {
+    if (*root == -1) {
+        if (!create || (*root = newPageTableNode()) == -1) return -1;
+    }
+    int node = *root;
+    int fanout = pageTableFanout();
+    for (int l = pageTableLevels - 1; ; l--) {
+        long slot = (long)node * fanout + ((vpn >> (l * pageTableBits)) & (fanout - 1));
+        if (references) (*references)++;
+        if (l == stop || ptEntries[slot] <= -2) {
+            if (level) *level = l;
+            return slot;
+        }
+        if (ptEntries[slot] == -1) {
+            if (!create) return -1;
+            int child = newPageTableNode();
+            if (child == -1) return -1;
+            ptEntries[slot] = child;
+        }
+        node = ptEntries[slot];
+    }
+}
+
+// Index of the leaf entry for vpn; see walkPageTableTo().
+long walkPageTable(int *root, int vpn, bool create, int *references) {
+    return walkPageTableTo(root, vpn, 0, create, references, NULL);
+}
+
+long pageTableSlot(Process *p, int vpn, bool create, int *references) {
+    return walkPageTable(&p->pageTableRoot, vpn, create, references);
+}
+
+// Frame mapped at vpn, -1 if nothing is, or -2 - slot for a page in swap.
+int lookupPage(Process *p, int vpn) {
+    int level;
+    long slot = walkPageTableTo(&p->pageTableRoot, vpn, 0, false, NULL, &level);
+    if (slot == -1) return -1;
+    if (level > 0) return -2 - ptEntries[slot] + (vpn & (hugePageSpan(level) - 1));
+    return ptEntries[slot];
+}
+
+void tlbInvalidateProcess(int processID) {
+    for (int i = 0; i < tlbSets * tlbWays; i++) {
+        if (tlb[i].valid && tlb[i].processID == processID) {
+            tlb[i].valid = false;
+        }
+    }
+}
+
+// Page replacement. Pages are identified by pageKey(); every policy keeps its
+// pages on up to four intrusive lists with a hash index, so a hit, a miss and
+// a removal each cost O(1) (CLOCK's hand sweep is amortised O(1)).
+//   FIFO, LRU, CLOCK: residents on LIST_T1
+//   ARC: recency T1, frequency T2, ghosts B1/B2, adaptive target arcTarget
+//   2Q:  A1in on T1 (FIFO), Am on T2 (LRU), ghosts A1out on B1
+// OPT cannot run online; it is replayed from the recorded reference string.
+uint64_t pageKey(int processID, int vpn) {
+    return (uint64_t)processID << 32 | (uint32_t)vpn;
+}
+
+// Returns false, leaving an empty map with no table, if the table cannot be
+// allocated; the first keyMapPut() then tries again.
+bool keyMapInit(KeyMap *map, long capacity) {
+    long size = 16;
+    while (size < capacity * 2) size <<= 1;
+    freeArray(map->keys);
+    freeArray(map->values);
+    map->keys = allocArray(size * sizeof(uint64_t));
+    map->values = allocArray(size * sizeof(long));
+    map->capacity = size;
+    map->count = 0;
+    if (!map->keys || !map->values) {
+        freeArray(map->keys);
+        freeArray(map->values);
+        map->keys = NULL;
+        map->values = NULL;
+        map->capacity = 0;
+        return false;
+    }
+    for (long i = 0; i < size; i++) {
+        map->keys[i] = EMPTY_KEY;
+    }
+    return true;
+}
+
+long keyMapFind(const KeyMap *map, uint64_t key) {
+    if (map->capacity == 0) return -1;
+    long i = (key * 0x9e3779b97f4a7c15ull) >> 20 & (map->capacity - 1);
+    while (map->keys[i] != EMPTY_KEY) {
+        if (map->keys[i] == key) return i;
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return -1;
+}
+
+long keyMapGet(const KeyMap *map, uint64_t key, long missing) {
+    long i = keyMapFind(map, key);
+    return i == -1 ? missing : map->values[i];
+}
+
+// Makes room for one more key. Returns false if the map is full and cannot
+// grow; a table that fails to grow stays in use while it has an empty slot.
+bool keyMapReserve(KeyMap *map) {
+    if ((map->count + 1) * 2 <= map->capacity) return true;
+    KeyMap grown = {0};
+    if (!keyMapInit(&grown, map->capacity)) return map->count + 1 < map->capacity;
+    for (long i = 0; i < map->capacity; i++) {
+        if (map->keys[i] == EMPTY_KEY) continue;
+        long j = (map->keys[i] * 0x9e3779b97f4a7c15ull) >> 20 & (grown.capacity - 1);
+        while (grown.keys[j] != EMPTY_KEY) j = (j + 1) & (grown.capacity - 1);
+        grown.keys[j] = map->keys[i];
+        grown.values[j] = map->values[i];
+        grown.count++;
+    }
+    freeArray(map->keys);
+    freeArray(map->values);
+    *map = grown;
+    return true;
+}
+
+// Returns false if key is new and the map has no room for it.
+bool keyMapPut(KeyMap *map, uint64_t key, long value) {
+    if (!keyMapReserve(map) && keyMapFind(map, key) == -1) return false;
+    long i = (key * 0x9e3779b97f4a7c15ull) >> 20 & (map->capacity - 1);
+    while (map->keys[i] != EMPTY_KEY && map->keys[i] != key) {
+        i = (i + 1) & (map->capacity - 1);
+    }
+    if (map->keys[i] == EMPTY_KEY) map->count++;
+    map->keys[i] = key;
+    map->values[i] = value;
+    return true;
+}
+
+// Linear-probing delete with backward shift, so lookups never see tombstones.
+void keyMapRemove(KeyMap *map, uint64_t key) {
+    long i = keyMapFind(map, key);
+    if (i == -1) return;
+    long mask = map->capacity - 1;
+    for (long j = (i + 1) & mask; map->keys[j] != EMPTY_KEY; j = (j + 1) & mask) {
+        long home = (map->keys[j] * 0x9e3779b97f4a7c15ull) >> 20 & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->keys[i] = map->keys[j];
+            map->values[i] = map->values[j];
+            i = j;
+        }
+    }
+    map->keys[i] = EMPTY_KEY;
+    map->count--;
+}
+
+void replacementInit(ReplacementState *r, int policy, int capacity) {
+    r->policy = policy;
+    r->capacity = capacity;
+    r->resident = 0;
+    r->nodeCount = 0;
+    r->freeNodes = -1;
+    r->clockHand = -1;
+    r->arcTarget = 0;
+    r->hits = r->faults = 0;
+    for (int l = 0; l < POLICY_LISTS; l++) {
+        r->head[l] = r->tail[l] = -1;
+        r->size[l] = 0;
+    }
+    keyMapInit(&r->index, 0); // Grows with the resident and ghost pages
+}
+
+// Makes room for one more node and index entry, so the next policyNode()
+// cannot fail. Returns false if either cannot grow.
+bool policyReserve(ReplacementState *r) {
+    if (r->freeNodes == -1 && r->nodeCount == r->nodeCapacity) {
+        int capacity = r->nodeCapacity ? r->nodeCapacity * 2 : 64;
+        PageNode *nodes = resizeArray(r->nodes, r->nodeCapacity * sizeof(PageNode), capacity * sizeof(PageNode));
+        if (!nodes) return false;
+        r->nodes = nodes;
+        r->nodeCapacity = capacity;
+    }
+    return keyMapReserve(&r->index);
+}
+
+// Takes a node for key; the caller has made room with policyReserve().
+int policyNode(ReplacementState *r, uint64_t key, int list) {
+    int node = r->freeNodes;
+    if (node != -1) {
+        r->freeNodes = r->nodes[node].next;
+    } else {
+        node = r->nodeCount++;
+    }
+    r->nodes[node].key = key;
+    r->nodes[node].list = list;
+    r->nodes[node].referenced = true;
+    keyMapPut(&r->index, key, node);
+    return node;
+}
+
+void listUnlink(ReplacementState *r, int node) {
+    PageNode *n = &r->nodes[node];
+    if (n->prev != -1) r->nodes[n->prev].next = n->next; else r->head[n->list] = n->next;
+    if (n->next != -1) r->nodes[n->next].prev = n->prev; else r->tail[n->list] = n->prev;
+    r->size[n->list]--;
+}
+
+void listAppend(ReplacementState *r, int list, int node) {
+    PageNode *n = &r->nodes[node];
+    n->list = list;
+    n->prev = r->tail[list];
+    n->next = -1;
+    if (r->tail[list] != -1) r->nodes[r->tail[list]].next = node; else r->head[list] = node;
+    r->tail[list] = node;
+    r->size[list]++;
+}
+
+// Inserts before the CLOCK hand, i.e. as the last page the hand will reach.
+void listInsertBeforeHand(ReplacementState *r, int node) {
+    int hand = r->clockHand;
+    if (hand == -1 || r->nodes[hand].prev == -1) {
+        if (hand == -1) {
+            listAppend(r, LIST_T1, node);
+            r->clockHand = node;
+            return;
+        }
+        PageNode *n = &r->nodes[node];
+        n->list = LIST_T1;
+        n->prev = -1;
+        n->next = hand;
+        r->nodes[hand].prev = node;
+        r->head[LIST_T1] = node;
+        r->size[LIST_T1]++;
+        return;
+    }
+    PageNode *n = &r->nodes[node];
+    n->list = LIST_T1;
+    n->prev = r->nodes[hand].prev;
+    n->next = hand;
+    r->nodes[n->prev].next = node;
+    r->nodes[hand].prev = node;
+    r->size[LIST_T1]++;
+}
+
+void dropNode(ReplacementState *r, int node) {
+    listUnlink(r, node);
+    keyMapRemove(&r->index, r->nodes[node].key);
+    r->nodes[node].next = r->freeNodes;
+    r->freeNodes = node;
+}
+
+bool isResidentList(int list) {
+    return list == LIST_T1 || list == LIST_T2;
+}
+
+bool policyHolds(const ReplacementState *r, uint64_t key) {
+    long node = keyMapGet(&r->index, key, -1);
+    return node != -1 && isResidentList(r->nodes[node].list);
+}
+
+// Moves the head of a resident list to a ghost list (or drops it when ghost is
+// -1) and reports it as the victim.
+void evictHead(ReplacementState *r, int from, int ghost, uint64_t *victim) {
+    int node = r->head[from];
+    *victim = r->nodes[node].key;
+    r->resident--;
+    if (ghost == -1) {
+        dropNode(r, node);
+    } else {
+        listUnlink(r, node);
+        listAppend(r, ghost, node);
+    }
+}
+
+bool arcReplace(ReplacementState *r, bool inB2, uint64_t *victim) {
+    int t1 = r->size[LIST_T1];
+    if (t1 > 0 && (t1 > r->arcTarget || (inB2 && t1 == r->arcTarget) || r->size[LIST_T2] == 0)) {
+        evictHead(r, LIST_T1, LIST_B1, victim);
+    } else if (r->size[LIST_T2] > 0) {
+        evictHead(r, LIST_T2, LIST_B2, victim);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool twoQReclaim(ReplacementState *r, uint64_t *victim) {
+    int kin = r->capacity / 4 > 0 ? r->capacity / 4 : 1;
+    int kout = r->capacity / 2 > 0 ? r->capacity / 2 : 1;
+    if (r->size[LIST_T1] > 0 && (r->size[LIST_T1] > kin || r->size[LIST_T2] == 0)) {
+        evictHead(r, LIST_T1, LIST_B1, victim);
+        if (r->size[LIST_B1] > kout) dropNode(r, r->head[LIST_B1]);
+    } else if (r->size[LIST_T2] > 0) {
+        evictHead(r, LIST_T2, -1, victim);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void policyHit(ReplacementState *r, uint64_t key) {
+    int node = (int)keyMapGet(&r->index, key, -1);
+    r->hits++;
+    switch (r->policy) {
+        case POLICY_LRU:
+            listUnlink(r, node);
+            listAppend(r, LIST_T1, node);
+            break;
+        case POLICY_CLOCK:
+            r->nodes[node].referenced = true;
+            break;
+        case POLICY_ARC:
+            listUnlink(r, node);
+            listAppend(r, LIST_T2, node);
+            break;
+        case POLICY_2Q:
+            if (r->nodes[node].list == LIST_T2) {
+                listUnlink(r, node);
+                listAppend(r, LIST_T2, node);
+            }
+            break;
+    }
+}
+
+// Records a fault on key and makes it resident. When needEvict is set a
+// resident page is evicted first and returned in *victim; returns false if
+// eviction was needed but nothing was resident, or if the policy's bookkeeping
+// cannot grow (key is then not inserted).
+bool policyMiss(ReplacementState *r, uint64_t key, bool needEvict, uint64_t *victim) {
+    r->faults++;
+    if (!policyReserve(r)) return false;
+    bool evicted = false;
+    int node;
+    switch (r->policy) {
+        case POLICY_FIFO:
+        case POLICY_LRU:
+            if (needEvict && r->resident > 0) {
+                evictHead(r, LIST_T1, -1, victim);
+                evicted = true;
+            }
+            if (needEvict && !evicted) return false;
+            listAppend(r, LIST_T1, policyNode(r, key, LIST_T1));
+            break;
+
+        case POLICY_CLOCK:
+            if (needEvict && r->resident > 0) {
+                while (r->nodes[r->clockHand].referenced) {
+                    r->nodes[r->clockHand].referenced = false;
+                    int next = r->nodes[r->clockHand].next;
+                    r->clockHand = next != -1 ? next : r->head[LIST_T1];
+                }
+                int hand = r->clockHand;
+                int next = r->nodes[hand].next != -1 ? r->nodes[hand].next : r->head[LIST_T1];
+                r->clockHand = next == hand ? -1 : next;
+                *victim = r->nodes[hand].key;
+                r->resident--;
+                dropNode(r, hand);
+                evicted = true;
+            }
+            if (needEvict && !evicted) return false;
+            listInsertBeforeHand(r, policyNode(r, key, LIST_T1));
+            break;
+
+        case POLICY_ARC:
+            node = (int)keyMapGet(&r->index, key, -1);
+            if (node != -1) { // Ghost hit: adapt the target towards the list that missed
+                bool inB2 = r->nodes[node].list == LIST_B2;
+                int b1 = r->size[LIST_B1], b2 = r->size[LIST_B2];
+                if (inB2) {
+                    int delta = b1 / b2 > 1 ? b1 / b2 : 1;
+                    r->arcTarget = r->arcTarget - delta > 0 ? r->arcTarget - delta : 0;
+                } else {
+                    int delta = b2 / b1 > 1 ? b2 / b1 : 1;
+                    r->arcTarget = r->arcTarget + delta < r->capacity ? r->arcTarget + delta : r->capacity;
+                }
+                if (needEvict) {
+                    evicted = arcReplace(r, inB2, victim);
+                    if (!evicted) return false;
+                }
+                listUnlink(r, node);
+                listAppend(r, LIST_T2, node);
+                break;
+            }
+            if (r->size[LIST_T1] + r->size[LIST_B1] >= r->capacity) {
+                if (r->size[LIST_B1] > 0) {
+                    dropNode(r, r->head[LIST_B1]);
+                    if (needEvict) evicted = arcReplace(r, false, victim);
+                } else if (needEvict && r->size[LIST_T1] > 0) {
+                    evictHead(r, LIST_T1, -1, victim);
+                    evicted = true;
+                }
+            } else {
+                int total = r->size[LIST_T1] + r->size[LIST_T2] + r->size[LIST_B1] + r->size[LIST_B2];
+                if (total >= 2 * r->capacity && r->size[LIST_B2] > 0) {
+                    dropNode(r, r->head[LIST_B2]);
+                }
+                if (needEvict) evicted = arcReplace(r, false, victim);
+            }
+            if (needEvict && !evicted) return false;
+            listAppend(r, LIST_T1, policyNode(r, key, LIST_T1));
+            break;
+
+        case POLICY_2Q:
+            if (needEvict) {
+                evicted = twoQReclaim(r, victim);
+                if (!evicted) return false;
+            }
+            node = (int)keyMapGet(&r->index, key, -1);
+            if (node != -1) { // Seen recently in A1out: promote straight to Am
+                listUnlink(r, node);
+                listAppend(r, LIST_T2, node);
+            } else {
+                listAppend(r, LIST_T1, policyNode(r, key, LIST_T1));
+            }
+            break;
+    }
+    r->resident++;
+    return true;
+}
+
+// Forgets a page (resident or ghost), e.g. when its process is torn down.
+void policyRemove(ReplacementState *r, uint64_t key) {
+    int node = (int)keyMapGet(&r->index, key, -1);
+    if (node == -1) return;
+    if (isResidentList(r->nodes[node].list)) {
+        r->resident--;
+    }
+    if (r->clockHand == node) {
+        int next = r->nodes[node].next != -1 ? r->nodes[node].next : r->head[LIST_T1];
+        r->clockHand = next == node ? -1 : next;
+    }
+    dropNode(r, node);
+}
+
+// One reference in a shadow simulation with a fixed number of frames.
+void policyAccess(ReplacementState *r, uint64_t key) {
+    uint64_t victim;
+    if (policyHolds(r, key)) {
+        policyHit(r, key);
+    } else {
+        policyMiss(r, key, r->resident >= r->capacity, &victim);
+    }
+}
+
+void heapPush(OptHeapEntry *heap, long *size, long nextUse, uint64_t key) {
+    long i = (*size)++;
+    while (i > 0 && heap[(i - 1) / 2].nextUse < nextUse) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i].nextUse = nextUse;
+    heap[i].key = key;
+}
+
+OptHeapEntry heapPop(OptHeapEntry *heap, long *size) {
+    OptHeapEntry top = heap[0];
+    OptHeapEntry last = heap[--(*size)];
+    long i = 0;
+    while (2 * i + 1 < *size) {
+        long child = 2 * i + 1;
+        if (child + 1 < *size && heap[child + 1].nextUse > heap[child].nextUse) child++;
+        if (heap[child].nextUse <= last.nextUse) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*size > 0) heap[i] = last;
+    return top;
+}
+
+// One OPT pass over the n recorded references; returns false if a map cannot grow.
+bool replayOptimal(ReplacementState *r, long n, long *nextUse, OptHeapEntry *heap,
+                   KeyMap *upcoming, KeyMap *resident) {
+    long heapSize = 0;
+    for (long i = n - 1; i >= 0; i--) {
+        uint64_t key = pageReferences[i] & ~REFERENCE_REMOVED;
+        if (pageReferences[i] & REFERENCE_REMOVED) {
+            keyMapRemove(upcoming, key);
+        } else {
+            nextUse[i] = keyMapGet(upcoming, key, LONG_MAX);
+            if (!keyMapPut(upcoming, key, i)) return false;
+        }
+    }
+
+    r->hits = r->faults = 0;
+    r->resident = 0;
+    for (long i = 0; i < n; i++) {
+        uint64_t key = pageReferences[i] & ~REFERENCE_REMOVED;
+        if (pageReferences[i] & REFERENCE_REMOVED) {
+            if (keyMapFind(resident, key) != -1) {
+                keyMapRemove(resident, key);
+                r->resident--;
+            }
+            continue;
+        }
+        if (keyMapFind(resident, key) != -1) {
+            r->hits++;
+        } else {
+            r->faults++;
+            while (r->resident >= r->capacity && heapSize > 0) {
+                OptHeapEntry top = heapPop(heap, &heapSize);
+                if (keyMapGet(resident, top.key, -1) == top.nextUse) {
+                    keyMapRemove(resident, top.key);
+                    r->resident--;
+                }
+            }
+            r->resident++;
+        }
+        if (!keyMapPut(resident, key, nextUse[i])) return false;
+        heapPush(heap, &heapSize, nextUse[i], key);
+    }
+    return true;
+}
+
+// Belady's optimal policy over the recorded references: evict the resident
+// page whose next use is furthest away. Stale heap entries are skipped lazily.
+// The pass is rerun only once new references have been recorded. If the
+// reference string is incomplete or the pass runs out of memory, OPT's counts
+// are left at zero.
+void simulateOptimal(ReplacementState *r) {
+    if (optimalReferences == referenceCount) return;
+    long n = referenceCount;
+    long *nextUse = allocArray((n + 1) * sizeof(long));
+    OptHeapEntry *heap = allocArray((n + 1) * sizeof(OptHeapEntry));
+    KeyMap upcoming = {0}, resident = {0};
+    bool ok = !referencesDropped && nextUse && heap && keyMapInit(&upcoming, 1024) && keyMapInit(&resident, 1024)
+              && replayOptimal(r, n, nextUse, heap, &upcoming, &resident);
+    if (!ok) {
+        printf("Out of memory simulating OPT; its counts are left at zero\n");
+        r->hits = r->faults = 0;
+        r->resident = 0;
+    }
+
+    freeArray(nextUse);
+    freeArray(heap);
+    freeArray(upcoming.keys);
+    freeArray(upcoming.values);
+    freeArray(resident.keys);
+    freeArray(resident.values);
+    optimalReferences = n;
+}
+
+// Feeds one page reference to the comparison policies and records it for OPT.
+// If the string cannot grow, the reference is dropped and OPT is given up.
+void recordPageReference(uint64_t reference) {
+    if (referenceCount == referenceCapacity) {
+        long capacity = referenceCapacity ? referenceCapacity * 2 : 4096;
+        uint64_t *references = resizeArray(pageReferences, referenceCapacity * sizeof(uint64_t),
+                                           capacity * sizeof(uint64_t));
+        if (references) {
+            pageReferences = references;
+            referenceCapacity = capacity;
+        }
+    }
+    if (referenceCount < referenceCapacity) {
+        pageReferences[referenceCount++] = reference;
+    } else {
+        referencesDropped = true;
+    }
+    for (int i = 0; i < POLICY_OPT; i++) {
+        if (reference & REFERENCE_REMOVED) {
+            policyRemove(&shadowPolicies[i], reference & ~REFERENCE_REMOVED);
+        } else {
+            policyAccess(&shadowPolicies[i], reference);
+        }
+    }
+}
+
+// Entries for base and huge pages share the sets; a huge page is looked up by
+// its vpn >> (level * pageTableBits).
+TlbEntry *tlbSet(int processID, int vpn) {
+    return &tlb[(((unsigned)vpn * 2654435761u) ^ (unsigned)processID) % tlbSets * tlbWays];
+}
+
+void tlbInvalidatePage(int processID, int vpn) {
+    TlbEntry *set = tlbSet(processID, vpn);
+    for (int way = 0; way < tlbWays; way++) {
+        if (set[way].valid && set[way].processID == processID && set[way].vpn == vpn && set[way].pageLevel == 0) {
+            set[way].valid = false;
+        }
+    }
+}
+
+// Brings a non-resident page in, evicting a victim to swap if no frame is
+// free. Returns the frame, or -1 if memory and swap are both exhausted.
+int handlePageFault(int processID, int vpn, long slot) {
+    uint64_t key = pageKey(processID, vpn);
+    uint64_t victim;
+    int entry = ptEntries[slot];
+    bool needEvict = frameMap.freeFrames == 0;
+    pageFaults++;
+
+    if (needEvict && entry == -1 && swapMap.freeFrames == 0) {
+        outOfMemoryFaults++;
+        return -1;
+    }
+    if (!policyMiss(&pagingPolicy, key, needEvict, &victim)) {
+        outOfMemoryFaults++;
+        return -1;
+    }
+    if (entry <= -2) {
+        releaseFrameBit(&swapMap, -2 - entry);
+        swapIns++;
+    } else {
+        zeroFills++;
+    }
+
+    int frame;
+    if (needEvict) {
+        int victimProcess = (int)(victim >> 32);
+        int victimPage = (int)(uint32_t)victim;
+        long victimSlot = pageTableSlot(&processes[victimProcess], victimPage, false, NULL);
+        int swapSlot = nextFreeFrame(&swapMap, 0);
+        frame = ptEntries[victimSlot];
+        claimFrameBit(&swapMap, swapSlot);
+        ptEntries[victimSlot] = -2 - swapSlot;
+        tlbInvalidatePage(victimProcess, victimPage);
+        swapOuts++;
+        if (verbose) printf("  Evicted page %d of process %d from frame %d to swap slot %d\n",
+                            victimPage, victimProcess, frame, swapSlot);
+    } else {
+        frame = nextFreeFrame(&frameMap, 0);
+        claimFrameBit(&frameMap, frame);
+    }
+    ptEntries[slot] = frame;
+    if (verbose) printf("  Page fault: page %d of process %d loaded into frame %d%s\n",
+                        vpn, processID, frame, entry <= -2 ? " from swap" : "");
+    return frame;
+}
+
+void showDemandPagingStats() {
+    if (!demandPaging) return;
+    printf("\nDemand Paging (%s, %d frames, %d swap slots):\n",
+           replacementNames[pagingPolicy.policy], frameMap.frames, swapMap.frames);
+    printf("  Page faults: %ld  zero-fill: %ld  swap-ins: %ld  swap-outs: %ld  out of memory: %ld\n",
+           pageFaults, zeroFills, swapIns, swapOuts, outOfMemoryFaults);
+    printf("  Policy   Hits        Faults      Hit ratio  Fault rate\n");
+    simulateOptimal(&shadowPolicies[POLICY_OPT]);
+    for (int i = 0; i < REPLACEMENT_POLICIES; i++) {
+        ReplacementState *r = &shadowPolicies[i];
+        long references = r->hits + r->faults;
+        printf("  %-7s  %-10ld  %-10ld  %8.2f%%  %9.2f%%\n", replacementNames[i], r->hits, r->faults,
+               references ? r->hits * 100.0 / references : 0.0,
+               references ? r->faults * 100.0 / references : 0.0);
+    }
+}
+
+// Releases every frame and swap slot mapped below node, then the node itself.
+// Resident pages are also dropped from policy, if one tracks them.
+void freePageTableTree(int node, int level, int processID, int vpnBase, ReplacementState *policy) {
+    int fanout = pageTableFanout();
+    for (int i = 0; i < fanout; i++) {
+        int entry = ptEntries[(long)node * fanout + i];
+        int vpn = vpnBase | i << (level * pageTableBits);
+        if (entry == -1) continue;
+        if (level > 0 && entry <= -2) {
+            for (int frame = -2 - entry; frame < -2 - entry + hugePageSpan(level); frame++) {
+                releaseFrameBit(&frameMap, frame);
+            }
+            if (verbose) printf("  Freed huge page at frames %d-%d from process %d\n",
+                                -2 - entry, -2 - entry + hugePageSpan(level) - 1, processID);
+        } else if (level > 0) {
+            freePageTableTree(entry, level - 1, processID, vpn, policy);
+        } else {
+            if (policy) policyRemove(policy, pageKey(processID, vpn));
+            if (entry <= -2) {
+                releaseFrameBit(&swapMap, -2 - entry);
+                continue;
+            }
+            releaseFrameBit(&frameMap, entry);
+            if (verbose) printf("  Freed frame %d from process %d\n", entry, processID);
+        }
+    }
+    freePageTableNode(node);
+}
+
+// Translates a virtual address of a process through the TLB and, on a miss,
+// a page walk. Under demand paging a page that is not resident is faulted in.
+// Returns the physical address or -1 for an unmapped address.
+long translate(int processID, long vaddr) {
+    Process *p = &processes[processID];
+    translations++;
+    if (vaddr < 0 || vaddr >= (long)p->pageCount * pageSize) {
+        translationFaults++;
+        if (verbose) printf("  Address %ld is outside process %d\n", vaddr, processID);
+        return -1;
+    }
+    int vpn = (int)(vaddr / pageSize);
+    long offset = vaddr % pageSize;
+    if (demandPaging) recordPageReference(pageKey(processID, vpn));
+
+    // Every page size is probed at once, as in a TLB with mixed page sizes.
+    int largestLevel = hugePageMode != HUGE_NEVER ? hugePageLevel : 0;
+    for (int level = 0; level <= largestLevel; level++) {
+        int tag = vpn >> (level * pageTableBits);
+        TlbEntry *set = tlbSet(processID, tag);
+        for (int way = 0; way < tlbWays; way++) {
+            if (set[way].valid && set[way].processID == processID && set[way].vpn == tag &&
+                set[way].pageLevel == level) {
+                long frame = set[way].frame + (vpn & (hugePageSpan(level) - 1));
+                set[way].lastUse = ++tlbClock;
+                tlbHits++;
+                translationCycles += TLB_HIT_CYCLES;
+                if (demandPaging) policyHit(&pagingPolicy, pageKey(processID, vpn));
+                if (verbose) printf("  Address %ld of process %d -> %ld (TLB hit)\n",
+                                    vaddr, processID, frame * pageSize + offset);
+                return frame * pageSize + offset;
+            }
+        }
+    }
+
+    tlbMisses++;
+    pageWalks++;
+    int references = 0;
+    int level = 0;
+    long slot = walkPageTableTo(&p->pageTableRoot, vpn, 0, demandPaging, &references, &level);
+    walkReferences += references;
+    translationCycles += TLB_HIT_CYCLES + (long)references * MEMORY_ACCESS_CYCLES;
+    int frame = slot == -1 ? -1 : level > 0 ? -2 - ptEntries[slot] : ptEntries[slot];
+    if (demandPaging && slot != -1) {
+        if (frame < 0) {
+            frame = handlePageFault(processID, vpn, slot);
+        } else {
+            policyHit(&pagingPolicy, pageKey(processID, vpn));
+        }
+    }
+    if (frame < 0) {
+        translationFaults++;
+        return -1;
+    }
+
+    int tag = vpn >> (level * pageTableBits);
+    TlbEntry *set = tlbSet(processID, tag);
+    TlbEntry *victim = &set[0];
+    for (int way = 0; way < tlbWays; way++) {
+        if (!set[way].valid || (victim->valid && set[way].lastUse < victim->lastUse)) {
+            victim = &set[way];
+        }
+    }
+    if (victim->valid) tlbEvictions++;
+    victim->valid = true;
+    victim->processID = processID;
+    victim->vpn = tag;
+    victim->pageLevel = level;
+    victim->frame = frame;
+    victim->lastUse = ++tlbClock;
+    long physical = (long)(frame + (vpn & (hugePageSpan(level) - 1))) * pageSize + offset;
+    if (verbose) printf("  Address %ld of process %d -> %ld (TLB miss, %d-level walk)\n",
+                        vaddr, processID, physical, references);
+    return physical;
+}
+
+void showTranslationStats() {
+    printf("\nAddress Translation (page size %d, %d-level page table, %d-way x %d-set TLB):\n",
+           pageSize, pageTableLevels, tlbWays, tlbSets);
+    printf("  Translations: %ld  TLB hits: %ld (%.1f%%)  misses: %ld  evictions: %ld  faults: %ld\n",
+           translations, tlbHits, translations ? tlbHits * 100.0 / translations : 0.0,
+           tlbMisses, tlbEvictions, translationFaults);
+    printf("  Page walks: %ld  memory references: %ld  avg cycles/translation: %.1f\n",
+           pageWalks, walkReferences, translations ? translationCycles / (double)translations : 0.0);
+    printf("  TLB reach: %d  page-table nodes: %d (%ld bytes)\n",
+           tlbSets * tlbWays * pageSize, ptNodesInUse, (long)ptNodesInUse * pageTableFanout() * (long)sizeof(int));
+}
+
+// The process table is shared by paging and segmentation, which each reset
+// their own fields.
+bool initializeProcesses() {
+    freeArray(processes);
+    processes = allocArray(maxProcesses * sizeof(Process));
+    if (!processes) return false;
+    memset(processes, 0, maxProcesses * sizeof(Process));
+    return true;
+}
+
+// Returns false if the frame bitmaps or the TLB cannot be allocated.
+bool initializePaging() {
+    if (!frameBitmapInit(&frameMap, (int)(memorySize / pageSize))) return false;
+    for (int i = 0; i < maxProcesses; i++) {
+        processes[i].pageTableRoot = -1;
+        processes[i].pageCount = 0;
+        processes[i].mappedPages = 0;
+        processes[i].size = 0;
+    }
+    ptNodeCount = 0;
+    ptNodesInUse = 0;
+    ptFreeNodes = -1;
+    freeArray(tlb);
+    tlb = allocArray(tlbSets * tlbWays * sizeof(TlbEntry));
+    if (!tlb) return false;
+    memset(tlb, 0, tlbSets * tlbWays * sizeof(TlbEntry));
+    tlbClock = 0;
+    translations = tlbHits = tlbMisses = tlbEvictions = translationFaults = 0;
+    pageWalks = walkReferences = translationCycles = 0;
+    hugePromotions = hugePromotionsInPlace = hugeBytesCopied = hugeDemotions = hugeFallbacks = 0;
+    if (demandPaging) {
+        int swapSlots = swapPages ? swapPages : (int)(4L * frameMap.frames > INT_MAX ? INT_MAX : 4L * frameMap.frames);
+        if (!frameBitmapInit(&swapMap, swapSlots)) return false;
+        replacementInit(&pagingPolicy, pagingPolicy.policy, frameMap.frames);
+        for (int i = 0; i < REPLACEMENT_POLICIES; i++) {
+            replacementInit(&shadowPolicies[i], i, frameMap.frames);
+        }
+        referenceCount = 0;
+        referencesDropped = false;
+        optimalReferences = -1;
+        pageFaults = zeroFills = swapIns = swapOuts = outOfMemoryFaults = 0;
+    }
+    return true;
+}
+
+// Returns false if the block pool cannot hold the first block.
+bool initializeArena(MemoryManager *m, int algorithm, long arenaSize) {
+    m->algorithm = algorithm;
+    m->arenaSize = arenaSize;
+    m->freeSlots = -1;
+    for (int i = m->capacity - 1; i >= 0; i--) {
+        m->memory[i].next = m->freeSlots;
+        m->freeSlots = i;
+    }
+    m->totalBlocks = 0;
+    m->indexed = useFreeIndex && algorithm != TLSF_ALLOCATOR;
+    m->addrRoot = -1;
+    m->sizeRoot = -1;
+    m->treapSeed = 2463534242u;
+    m->tlsfFirstMap = 0;
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        m->tlsfSecondMap[fl] = 0;
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            m->tlsfHeads[fl][sl] = -1;
+        }
+    }
+    m->successfulAllocations = 0;
+    m->failedAllocations = 0;
+    m->totalRequests = 0;
+    m->freeBytes = 0;
+    m->freeBlocks = 0;
+    m->fragmentedBytes = 0;
+    m->smallFragments = 0;
+    memset(m->freeHistogram, 0, sizeof(m->freeHistogram));
+    m->internalBytes = 0;
+    m->compactions = 0;
+    m->bytesMoved = 0;
+    m->compactionNanos = 0;
+    m->compactionRescues = 0;
+    keyMapInit(&m->owners, 16); // Retried by the first allocation if it fails
+    m->head = newBlock(m);
+    if (m->head == -1) return false;
+    m->lastAlloc = m->head;
+    m->memory[m->head].start = 0;
+    m->memory[m->head].size = arenaSize;
+    m->memory[m->head].allocated = false;
+    m->memory[m->head].processID = -1;
+    m->memory[m->head].prev = -1;
+    m->memory[m->head].next = -1;
+
+    // The buddy arena is carved into naturally aligned powers of two, largest first.
+    if (algorithm == BUDDY_SYSTEM) {
+        for (int i = m->head; i != -1; i = m->memory[i].next) {
+            long size = m->memory[i].size;
+            if (size & (size - 1)) {
+                splitBlock(m, i, 1L << (63 - __builtin_clzl(size)));
+            }
+        }
+    }
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        indexFreeBlock(m, i);
+    }
+    return true;
+}
+
+bool initializeMemory(MemoryManager *m, int algorithm) {
+    return initializeArena(m, algorithm, memorySize);
+}
+
+void destroyArena(MemoryManager *m) {
+    freeArray(m->memory);
+    freeArray(m->owners.keys);
+    freeArray(m->owners.values);
+}
+
+void displayMemory(MemoryManager *m, const char* algoName) {
+    printf("\n=== %s Memory Layout ===\n", algoName);
+    printf("Start End  Size    Status      Process\n");
+    printf("----- ---  ----    ------      -------\n");
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        printf("%4ld %4ld %4ld    %-10s %d\n",
+               m->memory[i].start,
+               m->memory[i].start + m->memory[i].size - 1,
+               m->memory[i].size,
+               m->memory[i].allocated ? "Allocated" : "Free",
+               m->memory[i].processID);
+    }
+}
+
+int firstFit(MemoryManager *m, long size) {
+    if (m->indexed) {
+        return addrFirstFit(m, m->addrRoot, size, 0);
+    }
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size >= size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int bestFit(MemoryManager *m, long size) {
+    if (m->indexed) {
+        return sizeLowerBound(m, size);
+    }
+    int bestIndex = -1;
+    long minSize = LONG_MAX;
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size >= size && m->memory[i].size < minSize) {
+            bestIndex = i;
+            minSize = m->memory[i].size;
+        }
+    }
+    return bestIndex;
+}
+
+int worstFit(MemoryManager *m, long size) {
+    if (m->indexed) {
+        int largest = largestFreeBlock(m);
+        if (largest == -1 || m->memory[largest].size < size) return -1;
+        return sizeLowerBound(m, m->memory[largest].size);
+    }
+    int worstIndex = -1;
+    long maxSize = -1;
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size >= size && m->memory[i].size > maxSize) {
+            worstIndex = i;
+            maxSize = m->memory[i].size;
+        }
+    }
+    return worstIndex;
+}
+
+int nextFit(MemoryManager *m, long size) {
+    if (m->indexed) {
+        int index = addrFirstFit(m, m->addrRoot, size, m->memory[m->lastAlloc].start);
+        if (index == -1) {
+            index = addrFirstFit(m, m->addrRoot, size, 0);
+        }
+        if (index != -1) {
+            m->lastAlloc = index;
+        }
+        return index;
+    }
+    for (int i = m->lastAlloc; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size >= size) {
+            m->lastAlloc = i;
+            return i;
+        }
+    }
+    for (int i = m->head; i != m->lastAlloc; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size >= size) {
+            m->lastAlloc = i;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Buddy blocks are the smallest free power of two that fits, i.e. Best Fit on
+// the rounded size that allocate() passes in.
+int buddyFit(MemoryManager *m, long size) {
+    return bestFit(m, size);
+}
+
+// Good fit in O(1): round the request up to the next class so every block in
+// the chosen list fits, then take the first non-empty list via the bitmaps.
+int tlsfFit(MemoryManager *m, long size) {
+    int fl, sl;
+    int log2 = 63 - __builtin_clzl(size);
+    long rounded = size;
+    if (size >= TLSF_SL_COUNT) {
+        rounded += (1L << (log2 - TLSF_SL_LOG2)) - 1;
+    }
+    tlsfMapping(rounded, &fl, &sl);
+
+    if (fl < TLSF_FL_COUNT) {
+        unsigned slMap = m->tlsfSecondMap[fl] & (~0u << sl);
+        if (!slMap) {
+            uint64_t flMap = fl + 1 < TLSF_FL_COUNT ? m->tlsfFirstMap & (~0ull << (fl + 1)) : 0;
+            if (flMap) {
+                fl = __builtin_ctzll(flMap);
+                slMap = m->tlsfSecondMap[fl];
+            }
+        }
+        if (slMap) {
+            return m->tlsfHeads[fl][__builtin_ctz(slMap)];
+        }
+    }
+
+    // Rounding up can skip a block in the request's own class that still fits.
+    tlsfMapping(size, &fl, &sl);
+    for (int i = m->tlsfHeads[fl][sl]; i != -1; i = m->memory[i].freeNext) {
+        if (m->memory[i].size >= size) return i;
+    }
+    return -1;
+}
+
+int (*fitFunctions[ALGORITHMS])(MemoryManager*, long) = {firstFit, bestFit, worstFit, nextFit, buddyFit, tlsfFit};
+
+long roundUpPowerOfTwo(long size) {
+    long rounded = 1;
+    while (rounded < size) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+// Coalesces a freed buddy block with its buddy for as long as the buddy is free
+// and whole; returns the resulting block.
+int mergeBuddies(MemoryManager *m, int index) {
+    while (1) {
+        Block *b = &m->memory[index];
+        bool upperHalf = b->start & b->size;
+        int buddy = upperHalf ? b->prev : b->next;
+        if (buddy == -1 || m->memory[buddy].allocated || m->memory[buddy].size != b->size) {
+            return index;
+        }
+        unindexFreeBlock(m, buddy);
+        if (upperHalf) {
+            mergeWithNext(m, buddy);
+            index = buddy;
+        } else {
+            mergeWithNext(m, index);
+        }
+    }
+}
+
+uint64_t nowNanos() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+// Reads the usage counters; O(1) whatever the number of blocks.
+void computeUsage(MemoryManager *m, long *allocated, long *freeMemory, long *fragmentedSize) {
+    *allocated = m->arenaSize - m->freeBytes;
+    *freeMemory = m->freeBytes;
+    *fragmentedSize = m->fragmentedBytes;
+}
+
+// Size of the largest free block. The address index keeps it at the root and
+// TLSF only has to look through its highest non-empty class; the --no-index
+// reference path scans.
+long largestFreeSize(MemoryManager *m) {
+    if (m->indexed) {
+        return m->addrRoot == -1 ? 0 : m->memory[m->addrRoot].maxFree;
+    }
+    long largest = 0;
+    if (m->algorithm == TLSF_ALLOCATOR) {
+        if (m->tlsfFirstMap == 0) return 0;
+        int fl = 63 - __builtin_clzll(m->tlsfFirstMap);
+        int sl = 31 - __builtin_clz(m->tlsfSecondMap[fl]);
+        for (int i = m->tlsfHeads[fl][sl]; i != -1; i = m->memory[i].freeNext) {
+            if (m->memory[i].size > largest) largest = m->memory[i].size;
+        }
+        return largest;
+    }
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated && m->memory[i].size > largest) largest = m->memory[i].size;
+    }
+    return largest;
+}
+
+// Compaction slides allocated blocks towards address 0 so the free space they
+// leave behind collects into one block at the top. Each move swaps an
+// allocated block with the free block just below it; handles stay valid and
+// only the block's start changes.
+int firstFreeBlock(MemoryManager *m) {
+    if (m->indexed) {
+        int t = m->addrRoot;
+        while (t != -1 && m->memory[t].addrLeft != -1) {
+            t = m->memory[t].addrLeft;
+        }
+        return t;
+    }
+    for (int i = m->head; i != -1; i = m->memory[i].next) {
+        if (!m->memory[i].allocated) return i;
+    }
+    return -1;
+}
+
+// Moves at most maxMoves blocks, stopping before the total would pass maxBytes;
+// the first move is always made, so a budget smaller than the next block still
+// makes progress. Returns the bytes moved. Buddy blocks are never moved, since
+// that would break their alignment.
+long compactMemory(MemoryManager *m, long maxBytes, int maxMoves) {
+    if (m->algorithm == BUDDY_SYSTEM) return 0;
+    uint64_t start = nowNanos();
+    long moved = 0;
+    int moves = 0;
+    int hole = firstFreeBlock(m);
+    while (hole != -1 && m->memory[hole].next != -1 && moves < maxMoves) {
+        Block *h = &m->memory[hole];
+        int index = h->next;
+        Block *b = &m->memory[index];
+        if (!b->allocated) {
+            unindexFreeBlock(m, hole);
+            unindexFreeBlock(m, index);
+            mergeWithNext(m, hole);
+            indexFreeBlock(m, hole);
+            continue;
+        }
+        if (moves > 0 && moved + b->size > maxBytes) break;
+
+        // An aligned block may only slide to its next aligned start; what is
+        // left below it stays behind as a free block of its own.
+        long align = 1L << b->alignShift;
+        long target = (h->start + align - 1) / align * align;
+        if (target == b->start) {
+            hole = b->next;
+            while (hole != -1 && m->memory[hole].allocated) hole = m->memory[hole].next;
+            continue;
+        }
+        unindexFreeBlock(m, hole);
+        if (target > h->start) {
+            int gap = newBlock(m);
+            if (gap == -1) {
+                indexFreeBlock(m, hole);
+                break;
+            }
+            h = &m->memory[hole];
+            b = &m->memory[index];
+            Block *g = &m->memory[gap];
+            g->start = h->start;
+            g->size = target - h->start;
+            g->allocated = false;
+            g->processID = -1;
+            g->prev = h->prev;
+            g->next = hole;
+            if (h->prev != -1) m->memory[h->prev].next = gap; else m->head = gap;
+            h->prev = gap;
+            h->start = target;
+            h->size -= g->size;
+            indexFreeBlock(m, gap);
+        }
+        b->start = h->start;
+        h->start = b->start + b->size;
+        int prev = h->prev, after = b->next;
+        b->prev = prev;
+        b->next = hole;
+        h->prev = index;
+        h->next = after;
+        if (prev != -1) m->memory[prev].next = index; else m->head = index;
+        if (after != -1) m->memory[after].prev = hole;
+        if (after != -1 && !m->memory[after].allocated) {
+            unindexFreeBlock(m, after);
+            mergeWithNext(m, hole);
+        }
+        indexFreeBlock(m, hole);
+        moved += b->size;
+        moves++;
+    }
+    if (moves > 0) {
+        m->compactions++;
+        m->bytesMoved += moved;
+    }
+    m->compactionNanos += nowNanos() - start;
+    return moved;
+}
+
+// One step in the configured mode: everything, one block, or a byte budget.
+long compactionStep(MemoryManager *m) {
+    switch (compactionMode) {
+        case COMPACT_FULL:
+            return compactMemory(m, LONG_MAX, INT_MAX);
+        case COMPACT_INCREMENTAL:
+            return compactMemory(m, LONG_MAX, 1);
+        case COMPACT_BUDGETED:
+            return compactMemory(m, compactionBudget, INT_MAX);
+        default:
+            return 0;
+    }
+}
+
+// Runs after a failed fit. Incremental mode keeps stepping only until the
+// request fits; the other modes take a single step. Returns the fitted block.
+int compactForRequest(MemoryManager *m, long size, int (*fitFunction)(MemoryManager*, long)) {
+    int index = -1;
+    while (index == -1 && compactionStep(m) > 0) {
+        index = fitFunction(m, size);
+        if (compactionMode != COMPACT_INCREMENTAL) break;
+    }
+    if (index != -1) m->compactionRescues++;
+    return index;
+}
+
+// Takes a step after frees once small fragments make up too much of the free
+// space, using the same metric as showCurrentStats().
+void compactIfFragmented(MemoryManager *m) {
+    if (compactionMode == COMPACT_OFF || compactionThreshold <= 0) return;
+    long allocated, freeMemory, fragmentedSize;
+    computeUsage(m, &allocated, &freeMemory, &fragmentedSize);
+    if (freeMemory > 0 && fragmentedSize * 100.0f / freeMemory > compactionThreshold) {
+        compactionStep(m);
+    }
+}
+
+// Every allocated block is on its process's ownership list, a doubly linked
+// list through the blocks themselves whose head is kept in m->owners, so
+// freeing a process visits only the blocks it owns. Handles of allocated blocks
+// never change: splits keep the first half and merges only absorb free blocks.
+void ownerLink(MemoryManager *m, int index) {
+    Block *b = &m->memory[index];
+    uint64_t key = (uint32_t)b->processID;
+    int head = (int)keyMapGet(&m->owners, key, -1);
+    b->ownerPrev = -1;
+    b->ownerNext = head;
+    if (head != -1) m->memory[head].ownerPrev = index;
+    keyMapPut(&m->owners, key, index);
+}
+
+void ownerUnlink(MemoryManager *m, int index) {
+    Block *b = &m->memory[index];
+    if (b->ownerNext != -1) m->memory[b->ownerNext].ownerPrev = b->ownerPrev;
+    if (b->ownerPrev != -1) {
+        m->memory[b->ownerPrev].ownerNext = b->ownerNext;
+    } else if (b->ownerNext != -1) {
+        keyMapPut(&m->owners, (uint32_t)b->processID, b->ownerNext);
+    } else {
+        keyMapRemove(&m->owners, (uint32_t)b->processID);
+    }
+}
+
+// Rounds a request up to the first size class that holds it, or past the
+// largest class to a multiple of it.
+long roundToSizeClass(long size) {
+    if (sizeClassCount == 0) return size;
+    int low = 0, high = sizeClassCount - 1;
+    if (size > sizeClassTable[high]) {
+        return (size + sizeClassTable[high] - 1) / sizeClassTable[high] * sizeClassTable[high];
+    }
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (sizeClassTable[mid] < size) low = mid + 1; else high = mid;
+    }
+    return sizeClassTable[low];
+}
+
+// Shared body of allocate() and the specialized allocators below. Always inlined
+// so that a constant fitFunction becomes a direct, inlinable call. The request is
+// rounded to its size class and its start aligned to align (a power of two):
+// the fit looks for room for the worst-case padding, which is then split off
+// in front as a free block. Buddy blocks are aligned to their own size, so
+// there the alignment only raises the size.
+static inline __attribute__((always_inline))
+int allocateWith(MemoryManager *m, long size, long align, int (*fitFunction)(MemoryManager*, long),
+                 const char* algoName, int processID) {
+    m->totalRequests++;
+    long requested = size;
+    size = roundToSizeClass(size);
+    long need = size;
+    if (m->algorithm == BUDDY_SYSTEM) {
+        size = need = roundUpPowerOfTwo(size > align ? size : align);
+        align = 1;
+    } else if (align > 1) {
+        need = size + align - 1;
+    }
+    int index = fitFunction(m, need);
+    if (index == -1 && compactionMode != COMPACT_OFF) {
+        long moved = m->bytesMoved;
+        index = compactForRequest(m, need, fitFunction);
+        if (verbose && m->bytesMoved > moved) printf("  [%s] Compacted memory, moved %ld bytes\n",
+                                                     algoName, m->bytesMoved - moved);
+    }
+    
+    if (index == -1) {
+        if (verbose) printf("  [%s] Failed to allocate %ld bytes for process %d\n", algoName, size, processID);
+        m->failedAllocations++;
+        return -1;
+    }
+    if (!keyMapReserve(&m->owners) && keyMapFind(&m->owners, (uint32_t)processID) == -1) {
+        if (verbose) printf("  [%s] Cannot track process %d - out of ownership memory\n", algoName, processID);
+        m->failedAllocations++;
+        return -1;
+    }
+
+    // Buddy blocks are halved until they fit; everything else is cut once.
+    unindexFreeBlock(m, index);
+    long padding = (m->memory[index].start + align - 1) / align * align - m->memory[index].start;
+    if (padding > 0) {
+        int aligned = splitBlock(m, index, padding);
+        if (aligned == -1) {
+            indexFreeBlock(m, index);
+            if (verbose) printf("  [%s] Cannot split - out of block memory\n", algoName);
+            m->failedAllocations++;
+            return -1;
+        }
+        indexFreeBlock(m, index);
+        index = aligned;
+    }
+    while (m->memory[index].size > size) {
+        long cut = m->algorithm == BUDDY_SYSTEM ? m->memory[index].size / 2 : size;
+        int rest = splitBlock(m, index, cut);
+        if (rest == -1) {
+            indexFreeBlock(m, index);
+            if (verbose) printf("  [%s] Cannot split - out of block memory\n", algoName);
+            m->failedAllocations++;
+            return -1;
+        }
+        indexFreeBlock(m, rest);
+    }
+
+    m->memory[index].allocated = true;
+    m->memory[index].alignShift = (uint8_t)__builtin_ctzl(align);
+    m->memory[index].processID = processID;
+    m->memory[index].requested = requested;
+    m->internalBytes += size - requested;
+    ownerLink(m, index);
+    m->successfulAllocations++;
+    
+    if (verbose) printf("  [%s] Allocated %ld bytes at %ld-%ld for process %d\n", 
+           algoName, size, 
+           m->memory[index].start,
+           m->memory[index].start + size - 1,
+           processID);
+    return index;
+}
+
+// Returns the allocated block, or -1 if the request failed.
+int allocate(MemoryManager *m, long size, int (*fitFunction)(MemoryManager*, long), const char* algoName, int processID) {
+    return allocateWith(m, size, requestAlignment, fitFunction, algoName, processID);
+}
+
+// One copy of allocate() per fit policy with the fit bound at compile time, so
+// the search is inlined into the split logic instead of called through a pointer.
+#define SPECIALIZED_ALLOCATOR(fit) \
+    int fit##Allocate(MemoryManager *m, long size, long align, const char* algoName, int processID) { \
+        return allocateWith(m, size, align, fit, algoName, processID); \
+    }
+
+SPECIALIZED_ALLOCATOR(firstFit)
+SPECIALIZED_ALLOCATOR(bestFit)
+SPECIALIZED_ALLOCATOR(worstFit)
+SPECIALIZED_ALLOCATOR(nextFit)
+SPECIALIZED_ALLOCATOR(buddyFit)
+SPECIALIZED_ALLOCATOR(tlsfFit)
+
+// Allocates with the manager's own fit policy.
+int allocateAligned(MemoryManager *m, long size, long align, const char* algoName, int processID) {
+    switch (m->algorithm) {
+        case 0: return firstFitAllocate(m, size, align, algoName, processID);
+        case 1: return bestFitAllocate(m, size, align, algoName, processID);
+        case 2: return worstFitAllocate(m, size, align, algoName, processID);
+        case 3: return nextFitAllocate(m, size, align, algoName, processID);
+        case BUDDY_SYSTEM: return buddyFitAllocate(m, size, align, algoName, processID);
+        default: return tlsfFitAllocate(m, size, align, algoName, processID);
+    }
+}
+
+int allocateBlock(MemoryManager *m, long size, const char* algoName, int processID) {
+    return allocateAligned(m, size, requestAlignment, algoName, processID);
+}
+
+// Merges a block that has just been marked free with its free neighbours (or its
+// buddy) and indexes the result, which is returned.
+int coalesceFreedBlock(MemoryManager *m, int index) {
+    if (m->algorithm == BUDDY_SYSTEM) {
+        index = mergeBuddies(m, index);
+        indexFreeBlock(m, index);
+        return index;
+    }
+    int prev = m->memory[index].prev;
+    if (prev != -1 && !m->memory[prev].allocated) {
+        unindexFreeBlock(m, prev);
+        mergeWithNext(m, prev);
+        index = prev;
+    }
+    int next = m->memory[index].next;
+    if (next != -1 && !m->memory[next].allocated) {
+        unindexFreeBlock(m, next);
+        mergeWithNext(m, index);
+    }
+    indexFreeBlock(m, index);
+    return index;
+}
+
+// Frees a single allocated block, as returned by allocate().
+void freeBlock(MemoryManager *m, int index) {
+    ownerUnlink(m, index);
+    m->internalBytes -= m->memory[index].size - m->memory[index].requested;
+    m->memory[index].allocated = false;
+    m->memory[index].processID = -1;
+    coalesceFreedBlock(m, index);
+    compactIfFragmented(m);
+}
+
+// First half of a free: takes the process's whole ownership list out of the map
+// and chains it onto *pending (through ownerNext) without coalescing anything.
+// Returns the number of blocks released.
+int releaseProcessBlocks(MemoryManager *m, int processID, int *pending, const char* algoName) {
+    long slot = keyMapFind(&m->owners, (uint32_t)processID);
+    if (slot == -1) return 0;
+    int first = (int)m->owners.values[slot];
+    keyMapRemove(&m->owners, (uint32_t)processID);
+    int released = 0, last = -1;
+    for (int i = first; i != -1; i = m->memory[i].ownerNext) {
+        if (verbose) printf("  [%s] Freed block at %ld-%ld (%ld bytes) for process %d\n",
+               algoName,
+               m->memory[i].start,
+               m->memory[i].start + m->memory[i].size - 1,
+               m->memory[i].size,
+               processID);
+        m->internalBytes -= m->memory[i].size - m->memory[i].requested;
+        // Buddies merge pairwise, so they stay allocated until coalescePending()
+        // frees them one at a time.
+        if (m->algorithm != BUDDY_SYSTEM) {
+            m->memory[i].allocated = false;
+            m->memory[i].processID = PENDING_OWNER;
+        }
+        last = i;
+        released++;
+    }
+    m->memory[last].ownerNext = *pending;
+    *pending = first;
+    return released;
+}
+
+// Second half: merges every released block with its free neighbours. Each run
+// of adjacent free blocks is merged and indexed once, however many of its
+// blocks were released, instead of after every block.
+void coalescePending(MemoryManager *m, int pending) {
+    for (int i = pending, next; i != -1; i = next) {
+        next = m->memory[i].ownerNext;
+        if (m->algorithm == BUDDY_SYSTEM) {
+            m->memory[i].allocated = false;
+            m->memory[i].processID = -1;
+            coalesceFreedBlock(m, i);
+            continue;
+        }
+        if (m->memory[i].processID != PENDING_OWNER) continue; // Already merged into a run
+
+        int run = i;
+        while (m->memory[run].prev != -1 && !m->memory[m->memory[run].prev].allocated) {
+            run = m->memory[run].prev;
+        }
+        // Any non-pending free block in the run is still indexed and is unindexed
+        // as it is merged.
+        if (m->memory[run].processID != PENDING_OWNER) unindexFreeBlock(m, run);
+        m->memory[run].processID = -1;
+        for (int after = m->memory[run].next; after != -1 && !m->memory[after].allocated;
+             after = m->memory[run].next) {
+            if (m->memory[after].processID != PENDING_OWNER) unindexFreeBlock(m, after);
+            m->memory[after].processID = -1;
+            mergeWithNext(m, run);
+        }
+        indexFreeBlock(m, run);
+    }
+}
+
+void deallocate(MemoryManager *m, int processID, const char* algoName) {
+    int pending = -1;
+    if (releaseProcessBlocks(m, processID, &pending, algoName) == 0) {
+        if (verbose) printf("  [%s] No allocated blocks found for process %d\n", algoName, processID);
+        return;
+    }
+    coalescePending(m, pending);
+    compactIfFragmented(m);
+}
+
+// Bulk free for teardown storms: releases processes first..first+count-1 and
+// coalesces once at the end. Returns the number of blocks freed.
+int deallocateProcesses(MemoryManager *m, int firstProcessID, int count, const char* algoName) {
+    int pending = -1, released = 0;
+    for (int pid = firstProcessID; pid < firstProcessID + count; pid++) {
+        released += releaseProcessBlocks(m, pid, &pending, algoName);
+    }
+    if (released == 0) return 0;
+    coalescePending(m, pending);
+    compactIfFragmented(m);
+    if (verbose) printf("  [%s] Freed %d blocks of %d processes from %d\n", algoName, released, count, firstProcessID);
+    return released;
+}
+
+// Slab caches: small objects are grouped into size classes, and each class's
+// cache carves whole slabs from a parent MemoryManager (with any fit policy)
+// and hands out fixed-size objects from them. Slabs take a 1/SLAB_ARENA_SHARE
+// share of the parent, between the largest object and SLAB_MAX_SIZE units. A
+// cache keeps its slabs on partial, full and empty lists and serves from a
+// partial slab first; empty slabs beyond SLAB_EMPTY_KEEP go straight back to
+// the parent. Object handles are slab * SLAB_MAX_OBJECTS + the object's number
+// within the slab.
+#define SLAB_MAX_SIZE 4096
+#define SLAB_ARENA_SHARE 16
+#define SLAB_GRANULE 8
+#define SLAB_CLASSES 32 // Objects up to SLAB_CLASSES * SLAB_GRANULE units
+#define SLAB_MAX_OBJECTS (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_EMPTY_KEEP 1
+#define SLAB_OWNER -3 // processID of slab blocks in the parent
+
+enum { SLAB_PARTIAL, SLAB_FULL, SLAB_EMPTY };
+
+typedef struct {
+    int block; // Handle in the parent manager
+    int cache;
+    int state;
+    int prev; // Links in the cache's list for the state, or the free-slot chain
+    int next;
+    int inUse;
+    int *freeObjects; // Stack of free object numbers
+} Slab;
+
+typedef struct {
+    int objectSize;
+    int objectsPerSlab;
+    int lists[3];
+    int slabCount[3];
+    long allocations;
+    long frees;
+    long failures;
+    long slabsCarved;
+    long slabsReclaimed;
+} SlabCache;
+
+typedef struct {
+    MemoryManager *parent;
+    long slabSize;
+    SlabCache caches[SLAB_CLASSES];
+    Slab *slabs;
+    int slabCapacity;
+    int freeSlabSlots; // Recycled entries, chained through next
+} SlabAllocator;
+
+void initializeSlabs(SlabAllocator *a, MemoryManager *parent) {
+    memset(a, 0, sizeof(*a));
+    a->parent = parent;
+    a->slabSize = parent->arenaSize / SLAB_ARENA_SHARE;
+    if (a->slabSize < SLAB_CLASSES * SLAB_GRANULE) a->slabSize = SLAB_CLASSES * SLAB_GRANULE;
+    if (a->slabSize > SLAB_MAX_SIZE) a->slabSize = SLAB_MAX_SIZE;
+    a->freeSlabSlots = -1;
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        SlabCache *cache = &a->caches[c];
+        cache->objectSize = (c + 1) * SLAB_GRANULE;
+        cache->objectsPerSlab = (int)(a->slabSize / cache->objectSize);
+        cache->lists[SLAB_PARTIAL] = cache->lists[SLAB_FULL] = cache->lists[SLAB_EMPTY] = -1;
+    }
+}
+
+void slabUnlink(SlabAllocator *a, int index) {
+    Slab *s = &a->slabs[index];
+    SlabCache *c = &a->caches[s->cache];
+    if (s->prev != -1) a->slabs[s->prev].next = s->next; else c->lists[s->state] = s->next;
+    if (s->next != -1) a->slabs[s->next].prev = s->prev;
+    c->slabCount[s->state]--;
+}
+
+void slabLink(SlabAllocator *a, int index, int state) {
+    Slab *s = &a->slabs[index];
+    SlabCache *c = &a->caches[s->cache];
+    s->state = state;
+    s->prev = -1;
+    s->next = c->lists[state];
+    if (s->next != -1) a->slabs[s->next].prev = index;
+    c->lists[state] = index;
+    c->slabCount[state]++;
+}
+
+// Gives an unlinked slab back to the parent manager.
+void releaseSlab(SlabAllocator *a, int index) {
+    Slab *s = &a->slabs[index];
+    freeBlock(a->parent, s->block);
+    freeArray(s->freeObjects);
+    a->caches[s->cache].slabsReclaimed++;
+    s->next = a->freeSlabSlots;
+    a->freeSlabSlots = index;
+}
+
+// Frees every cached empty slab; returns how many went back to the parent.
+int reclaimSlabs(SlabAllocator *a) {
+    int released = 0;
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        while (a->caches[c].lists[SLAB_EMPTY] != -1) {
+            int index = a->caches[c].lists[SLAB_EMPTY];
+            slabUnlink(a, index);
+            releaseSlab(a, index);
+            released++;
+        }
+    }
+    return released;
+}
+
+// Carves a new empty slab for the cache. When the parent is out of room the
+// other caches' empty slabs are reclaimed first.
+int carveSlab(SlabAllocator *a, int cache) {
+    int block = allocateBlock(a->parent, a->slabSize, "Slab", SLAB_OWNER);
+    if (block == -1 && reclaimSlabs(a) > 0) {
+        block = allocateBlock(a->parent, a->slabSize, "Slab", SLAB_OWNER);
+    }
+    if (block == -1) return -1;
+
+    if (a->freeSlabSlots == -1) {
+        int capacity = a->slabCapacity ? a->slabCapacity * 2 : 64;
+        Slab *slabs = resizeArray(a->slabs, a->slabCapacity * sizeof(Slab), capacity * sizeof(Slab));
+        if (!slabs) {
+            freeBlock(a->parent, block);
+            return -1;
+        }
+        for (int i = capacity - 1; i >= a->slabCapacity; i--) {
+            slabs[i].next = a->freeSlabSlots;
+            a->freeSlabSlots = i;
+        }
+        a->slabs = slabs;
+        a->slabCapacity = capacity;
+    }
+    SlabCache *c = &a->caches[cache];
+    int *freeObjects = allocArray(c->objectsPerSlab * sizeof(int));
+    if (!freeObjects) {
+        freeBlock(a->parent, block);
+        return -1;
+    }
+    int index = a->freeSlabSlots;
+    a->freeSlabSlots = a->slabs[index].next;
+
+    Slab *s = &a->slabs[index];
+    s->block = block;
+    s->cache = cache;
+    s->inUse = 0;
+    s->freeObjects = freeObjects;
+    for (int i = 0; i < c->objectsPerSlab; i++) {
+        s->freeObjects[i] = c->objectsPerSlab - 1 - i;
+    }
+    c->slabsCarved++;
+    slabLink(a, index, SLAB_EMPTY);
+    return index;
+}
+
+// Returns an object handle, or -1 if the request failed or its size has no
+// class; sizes above SLAB_CLASSES * SLAB_GRANULE belong in the parent manager.
+int slabAllocate(SlabAllocator *a, int size) {
+    if (size <= 0 || size > SLAB_CLASSES * SLAB_GRANULE) return -1;
+    int cache = (size - 1) / SLAB_GRANULE;
+    SlabCache *c = &a->caches[cache];
+    int index = c->lists[SLAB_PARTIAL];
+    if (index == -1) index = c->lists[SLAB_EMPTY];
+    if (index == -1) index = carveSlab(a, cache);
+    if (index == -1) {
+        c->failures++;
+        return -1;
+    }
+
+    Slab *s = &a->slabs[index];
+    int object = s->freeObjects[c->objectsPerSlab - 1 - s->inUse];
+    s->inUse++;
+    int state = s->inUse == c->objectsPerSlab ? SLAB_FULL : SLAB_PARTIAL;
+    if (state != s->state) {
+        slabUnlink(a, index);
+        slabLink(a, index, state);
+    }
+    c->allocations++;
+    return index * SLAB_MAX_OBJECTS + object;
+}
+
+void slabFree(SlabAllocator *a, int object) {
+    int index = object / SLAB_MAX_OBJECTS;
+    Slab *s = &a->slabs[index];
+    SlabCache *c = &a->caches[s->cache];
+    s->inUse--;
+    s->freeObjects[c->objectsPerSlab - 1 - s->inUse] = object % SLAB_MAX_OBJECTS;
+    c->frees++;
+
+    int state = s->inUse == 0 ? SLAB_EMPTY : SLAB_PARTIAL;
+    if (state == s->state) return;
+    slabUnlink(a, index);
+    if (state == SLAB_EMPTY && c->slabCount[SLAB_EMPTY] >= SLAB_EMPTY_KEEP) {
+        releaseSlab(a, index);
+    } else {
+        slabLink(a, index, state);
+    }
+}
+
+// Arena offset of an object.
+long slabObjectAddress(SlabAllocator *a, int object) {
+    Slab *s = &a->slabs[object / SLAB_MAX_OBJECTS];
+    return a->parent->memory[s->block].start + (object % SLAB_MAX_OBJECTS) * a->caches[s->cache].objectSize;
+}
+
+// Frees the allocator's own bookkeeping. Slabs still in use are left allocated
+// in the parent, and the per-cache statistics stay readable.
+void destroySlabs(SlabAllocator *a) {
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        for (int state = SLAB_PARTIAL; state <= SLAB_EMPTY; state++) {
+            for (int i = a->caches[c].lists[state]; i != -1; i = a->slabs[i].next) {
+                freeArray(a->slabs[i].freeObjects);
+            }
+        }
+    }
+    freeArray(a->slabs);
+    a->slabs = NULL;
+}
+
+void showSlabStats(SlabAllocator *a) {
+    printf("Object  Partial  Full    Empty  In use    Allocs     Frees      Failed  Carved  Reclaimed\n");
+    for (int c = 0; c < SLAB_CLASSES; c++) {
+        SlabCache *cache = &a->caches[c];
+        if (cache->allocations == 0) continue;
+        long inUse = cache->allocations - cache->frees;
+        printf("%-6d  %-7d  %-6d  %-5d  %-8ld  %-9ld  %-9ld  %-6ld  %-6ld  %ld\n", cache->objectSize,
+               cache->slabCount[SLAB_PARTIAL], cache->slabCount[SLAB_FULL], cache->slabCount[SLAB_EMPTY],
+               inUse, cache->allocations, cache->frees, cache->failures, cache->slabsCarved,
+               cache->slabsReclaimed);
+    }
+}
+
+// NUMA placement. A process's home node is pid % numaNodes (the node it runs
+// on). Each policy picks a first-choice node - the home node, the next one in
+// round-robin order, or the preferred node - and falls back to the others in
+// order of their distance from it. Every placement is charged size x the
+// distance between the home node and the node the block landed on.
+bool initializeNuma(int distance) {
+    for (int a = 0; a < ALGORITHMS; a++) {
+        NumaArena *n = &numaArenas[a];
+        for (int node = 0; node < numaNodes; node++) {
+            if (!initializeMemory(&n->nodes[node], a)) return false;
+        }
+        n->nextInterleave = 0;
+        n->requests = n->successes = n->fallbacks = 0;
+        n->localBytes = n->remoteBytes = n->weightedCost = 0;
+    }
+    for (int i = 0; i < numaNodes; i++) {
+        for (int j = 0; j < numaNodes; j++) {
+            if (numaDistance[i][j] == 0) numaDistance[i][j] = i == j ? NUMA_LOCAL_DISTANCE : distance;
+        }
+    }
+    return true;
+}
+
+// Fills order[] with the nodes by distance from first (ties by node number).
+void numaFallbackOrder(int first, int *order) {
+    for (int i = 0; i < numaNodes; i++) {
+        order[i] = i;
+    }
+    for (int i = 1; i < numaNodes; i++) {
+        for (int j = i; j > 0; j--) {
+            int a = order[j - 1], b = order[j];
+            int da = a == first ? -1 : numaDistance[first][a];
+            int db = b == first ? -1 : numaDistance[first][b];
+            if (da <= db) break;
+            order[j - 1] = b;
+            order[j] = a;
+        }
+    }
+}
+
+int numaAllocate(NumaArena *n, int algorithm, long size, long align, int processID) {
+    int home = (int)((unsigned)processID % (unsigned)numaNodes);
+    int first = numaPolicy == NUMA_LOCAL ? home
+              : numaPolicy == NUMA_PREFERRED ? numaPreferredNode
+              : n->nextInterleave++ % numaNodes;
+    int order[MAX_NUMA_NODES];
+    numaFallbackOrder(first, order);
+    n->requests++;
+    for (int i = 0; i < numaNodes; i++) {
+        char name[40];
+        snprintf(name, sizeof(name), "%s node %d", algorithmNames[algorithm], order[i]);
+        int index = allocateAligned(&n->nodes[order[i]], size, align, name, processID);
+        if (index == -1) continue;
+        int distance = numaDistance[home][order[i]];
+        n->successes++;
+        if (i > 0) n->fallbacks++;
+        if (order[i] == home) n->localBytes += size; else n->remoteBytes += size;
+        n->weightedCost += (long)size * distance;
+        return index;
+    }
+    return -1;
+}
+
+void numaDeallocate(NumaArena *n, int algorithm, int processID) {
+    for (int node = 0; node < numaNodes; node++) {
+        char name[40];
+        snprintf(name, sizeof(name), "%s node %d", algorithmNames[algorithm], node);
+        deallocate(&n->nodes[node], processID, name);
+    }
+}
+
+void numaDeallocateProcesses(NumaArena *n, int algorithm, int firstProcessID, int count) {
+    for (int node = 0; node < numaNodes; node++) {
+        char name[40];
+        snprintf(name, sizeof(name), "%s node %d", algorithmNames[algorithm], node);
+        deallocateProcesses(&n->nodes[node], firstProcessID, count, name);
+    }
+}
+
+void numaUsage(const NumaArena *n, long *freeBytes, long *fragmentedBytes) {
+    *freeBytes = *fragmentedBytes = 0;
+    for (int node = 0; node < numaNodes; node++) {
+        *freeBytes += n->nodes[node].freeBytes;
+        *fragmentedBytes += n->nodes[node].fragmentedBytes;
+    }
+}
+
+void showNumaStats() {
+    if (numaNodes == 0) return;
+    printf("\nNUMA (%d nodes, %s placement", numaNodes, numaPolicyNames[numaPolicy]);
+    if (numaPolicy == NUMA_PREFERRED) printf(" on node %d", numaPreferredNode);
+    printf("):\n");
+    printf("Technique           Success  Fragmentation  Remote   Fallbacks  Avg distance\n");
+    for (int a = 0; a < ALGORITHMS; a++) {
+        NumaArena *n = &numaArenas[a];
+        long freeBytes, fragmentedBytes;
+        numaUsage(n, &freeBytes, &fragmentedBytes);
+        long placed = n->localBytes + n->remoteBytes;
+        printf("%-18s  %6.1f%%  %12.1f%%  %6.1f%%  %-9ld  %.2f\n", algorithmNames[a],
+               n->requests ? n->successes * 100.0 / n->requests : 0.0,
+               freeBytes ? fragmentedBytes * 100.0 / freeBytes : 0.0,
+               placed ? n->remoteBytes * 100.0 / placed : 0.0, n->fallbacks,
+               placed ? n->weightedCost / (double)placed : 0.0);
+    }
+}
+
+// Huge pages. In always mode allocatePages() maps every aligned range that a
+// request covers (or covers at least HUGE_MIN_USE_PERCENT of, at its tail) with
+// the largest page whose aligned run of frames is free, falling back to smaller
+// pages. Both always and defer mode then collapse ranges that ended up in base
+// pages once a run frees up, copying the pages unless their frames already form
+// one (promotion). Under frame pressure the rounded-up tails are split one
+// level at a time and their unused frames given back (demotion).
+
+// Frees the page-table nodes below node without touching the frames they map.
+void freePageTableNodes(int node, int level) {
+    int fanout = pageTableFanout();
+    for (int i = 0; level > 0 && i < fanout; i++) {
+        int entry = ptEntries[(long)node * fanout + i];
+        if (entry >= 0) freePageTableNodes(entry, level - 1);
+    }
+    freePageTableNode(node);
+}
+
+// Largest page size to map at vpn for a request ending at target, with its run
+// of frames in *run; 0 for a base page.
+int hugeLevelFor(int vpn, int target, int *run) {
+    if (hugePageMode != HUGE_ALWAYS) return 0;
+    for (int level = hugePageLevel; level > 0; level--) {
+        int span = hugePageSpan(level);
+        int remaining = target - vpn;
+        if (vpn % span || remaining * 100L < (long)span * HUGE_MIN_USE_PERCENT) continue;
+        *run = findAlignedFreeRun(&frameMap, span, span);
+        if (*run != -1) return level;
+        hugeFallbacks++;
+    }
+    return 0;
+}
+
+// Splits the huge page at slot (of the given level) into pages one level down.
+bool splitHugePage(long slot, int level) {
+    int node = newPageTableNode();
+    if (node == -1) return false;
+    int base = -2 - ptEntries[slot];
+    int span = hugePageSpan(level - 1);
+    for (int i = 0; i < pageTableFanout(); i++) {
+        ptEntries[(long)node * pageTableFanout() + i] = level > 1 ? -2 - (base + i * span) : base + i;
+    }
+    ptEntries[slot] = node;
+    hugeDemotions++;
+    return true;
+}
+
+// Gives back the frames a process has mapped past its last page. Returns the
+// number of frames released.
+int trimHugeBloat(int processID) {
+    Process *p = &processes[processID];
+    int released = 0;
+    while (p->mappedPages > p->pageCount) {
+        int vpn = p->mappedPages - 1;
+        int level;
+        long slot = walkPageTableTo(&p->pageTableRoot, vpn, 0, false, NULL, &level);
+        int span = hugePageSpan(level);
+        int start = vpn & ~(span - 1);
+        if (start < p->pageCount) {
+            if (!splitHugePage(slot, level)) break;
+            continue;
+        }
+        int base = level > 0 ? -2 - ptEntries[slot] : ptEntries[slot];
+        for (int frame = base; frame < base + span; frame++) {
+            releaseFrameBit(&frameMap, frame);
+        }
+        ptEntries[slot] = -1;
+        p->mappedPages = start;
+        released += span;
+    }
+    tlbInvalidateProcess(processID);
+    if (verbose && released) printf("  Split huge pages of process %d, releasing %d frames\n", processID, released);
+    return released;
+}
+
+// Trims other processes' rounded-up huge pages until at least frames frames
+// are free; the requester's own tail is about to be used.
+void reclaimHugeBloat(int frames, int requester) {
+    for (int pid = 0; pid < maxProcesses && frameMap.freeFrames < frames; pid++) {
+        if (pid != requester && processes[pid].mappedPages > processes[pid].pageCount) trimHugeBloat(pid);
+    }
+}
+
+// Collapses every aligned range of a process that is mapped but not by a page
+// of that size, largest pages first.
+void promoteHugePages(int processID) {
+    Process *p = &processes[processID];
+    long promotions = hugePromotions;
+    for (int level = hugePageLevel; level > 0; level--) {
+        int span = hugePageSpan(level);
+        for (int start = 0; start + span <= p->pageCount; start += span) {
+            int mapped;
+            long slot = walkPageTableTo(&p->pageTableRoot, start, level, false, NULL, &mapped);
+            if (slot == -1 || ptEntries[slot] <= -2 || ptEntries[slot] == -1) continue;
+
+            int first = lookupPage(p, start);
+            bool inPlace = first % span == 0;
+            for (int i = 1; inPlace && i < span; i++) {
+                inPlace = lookupPage(p, start + i) == first + i;
+            }
+            int run = first;
+            if (!inPlace) {
+                run = findAlignedFreeRun(&frameMap, span, span);
+                if (run == -1) continue;
+                for (int i = 0; i < span; i++) {
+                    releaseFrameBit(&frameMap, lookupPage(p, start + i));
+                    claimFrameBit(&frameMap, run + i);
+                }
+                hugeBytesCopied += (long)span * pageSize;
+            } else {
+                hugePromotionsInPlace++;
+            }
+            freePageTableNodes(ptEntries[slot], level - 1);
+            ptEntries[slot] = -2 - run;
+            hugePromotions++;
+            if (verbose) printf("  Promoted pages %d-%d of process %d to a huge page at frames %d-%d%s\n",
+                                start, start + span - 1, processID, run, run + span - 1,
+                                inPlace ? "" : " (copied)");
+        }
+    }
+    if (hugePromotions > promotions) tlbInvalidateProcess(processID);
+}
+
+void countHugePages(int node, int level, long *counts) {
+    int fanout = pageTableFanout();
+    for (int i = 0; i < fanout; i++) {
+        int entry = ptEntries[(long)node * fanout + i];
+        if (level > 0 && entry <= -2) {
+            counts[level]++;
+        } else if (level > 0 && entry >= 0) {
+            countHugePages(entry, level - 1, counts);
+        } else if (level == 0 && entry >= 0) {
+            counts[0]++;
+        }
+    }
+}
+
+void showHugePageStats() {
+    if (hugePageMode == HUGE_NEVER) return;
+    long counts[4] = {0};
+    long bloat = 0;
+    for (int pid = 0; pid < maxProcesses; pid++) {
+        if (processes[pid].pageTableRoot != -1) {
+            countHugePages(processes[pid].pageTableRoot, pageTableLevels - 1, counts);
+        }
+        bloat += processes[pid].mappedPages - processes[pid].pageCount;
+    }
+    printf("\nHuge Pages (%s, up to %d frames):\n", hugePageModeNames[hugePageMode], hugePageSpan(hugePageLevel));
+    printf("  Mapped pages:");
+    for (int level = 0; level <= hugePageLevel; level++) {
+        printf("%s %ld of %ld units", level ? "," : "", counts[level], (long)hugePageSpan(level) * pageSize);
+    }
+    printf("\n");
+    printf("  Promotions: %ld (%ld in place, %ld bytes copied)  demotions: %ld  fallbacks: %ld  bloat: %ld frames\n",
+           hugePromotions, hugePromotionsInPlace, hugeBytesCopied, hugeDemotions, hugeFallbacks, bloat);
+    long coverage = 0;
+    for (int i = 0; i < tlbSets * tlbWays; i++) {
+        if (tlb[i].valid) coverage += (long)hugePageSpan(tlb[i].pageLevel) * pageSize;
+    }
+    printf("  TLB coverage: %ld units (reach %d with base pages, %ld with the largest pages)\n", coverage,
+           tlbSets * tlbWays * pageSize, (long)tlbSets * tlbWays * hugePageSpan(hugePageLevel) * pageSize);
+}
+
+// Adds the pages to the process's page table; a process that already has pages
+// keeps them, so deallocatePages() releases everything it was given.
+bool allocatePages(int processID, long size) {
+    Process *p = &processes[processID];
+    long pages = (size + pageSize - 1) / pageSize;
+    if (p->pageCount + pages > INT_MAX) {
+        if (verbose) printf("  Request exceeds the page count of a process\n");
+        return false;
+    }
+    int pagesNeeded = (int)pages;
+    
+    if (verbose) printf("\nAttempting to allocate %d pages for process %d\n", pagesNeeded, processID);
+    
+    // Pages inside a rounded-up huge page are already backed.
+    int framesNeeded = p->pageCount + pagesNeeded - (p->mappedPages > p->pageCount ? p->mappedPages : p->pageCount);
+    if (framesNeeded < 0) framesNeeded = 0;
+    if (!demandPaging && framesNeeded > frameMap.freeFrames && hugePageMode != HUGE_NEVER) {
+        reclaimHugeBloat(framesNeeded, processID);
+    }
+    if (!demandPaging && framesNeeded > frameMap.freeFrames) {
+        if (verbose) printf("  Could only allocate %d of %d needed pages\n", frameMap.freeFrames, pagesNeeded);
+        return false;
+    }
+    if (p->pageCount + (long)pagesNeeded > maxVirtualPages()) {
+        if (verbose) printf("  Request exceeds the %ld-page virtual address space\n", maxVirtualPages());
+        return false;
+    }
+    if (demandPaging) { // Frames are assigned by the first translate() of each page
+        p->pageCount += pagesNeeded;
+        p->size += size;
+        p->processID = processID;
+        if (verbose) printf("  Reserved %d pages for process %d\n", pagesNeeded, processID);
+        return true;
+    }
+
+    int pageCount = p->pageCount;
+    int backed = p->mappedPages > p->pageCount ? p->mappedPages : p->pageCount;
+    int target = p->pageCount + pagesNeeded;
+    if (p->mappedPages > p->pageCount) p->pageCount = p->mappedPages < target ? p->mappedPages : target;
+    int run = contiguousPages ? findFreeRun(&frameMap, framesNeeded) : -1;
+    int next = run != -1 ? run : 0;
+    while (p->pageCount < target) {
+        int vpn = p->pageCount;
+        int level = hugeLevelFor(vpn, target, &run);
+        long slot = walkPageTableTo(&p->pageTableRoot, vpn, level, true, NULL, NULL);
+        if (slot == -1) {
+            // Give back what this request mapped. Its huge pages all start at or
+            // past backed, so the trim never has to split one.
+            p->pageCount = backed;
+            int released = trimHugeBloat(processID);
+            p->pageCount = pageCount;
+            if (verbose) printf("  Out of page-table memory, released %d frames\n", released);
+            return false;
+        }
+        if (level > 0) {
+            int span = hugePageSpan(level);
+            if (ptEntries[slot] >= 0) freePageTableNodes(ptEntries[slot], level - 1); // Left empty by a trim
+            for (int frame = run; frame < run + span; frame++) {
+                claimFrameBit(&frameMap, frame);
+            }
+            ptEntries[slot] = -2 - run;
+            p->mappedPages = vpn + span;
+            p->pageCount = p->mappedPages < target ? p->mappedPages : target;
+            if (verbose) printf("  Allocated huge page %d-%d (frames %d-%d) to process %d\n",
+                                vpn, vpn + span - 1, run, run + span - 1, processID);
+            continue;
+        }
+        int frame = nextFreeFrame(&frameMap, next);
+        if (frame == -1) frame = nextFreeFrame(&frameMap, 0);
+        claimFrameBit(&frameMap, frame);
+        ptEntries[slot] = frame;
+        next = frame + 1;
+        p->pageCount++;
+        p->mappedPages = p->pageCount;
+        if (verbose) printf("  Allocated page %d (frame %d) to process %d\n", 
+               p->pageCount-1, frame, processID);
+    }
+    p->size += size;
+    p->processID = processID;
+    if (hugePageMode != HUGE_NEVER) promoteHugePages(processID);
+    if (verbose) printf("  Successfully allocated %d pages for process %d\n", pagesNeeded, processID);
+    return true;
+}
+
+void deallocatePages(int processID) {
+    Process *p = &processes[processID];
+    if (verbose) printf("\nDeallocating pages for process %d\n", processID);
+    if (p->pageTableRoot != -1) {
+        freePageTableTree(p->pageTableRoot, pageTableLevels - 1, processID, 0, demandPaging ? &pagingPolicy : NULL);
+        p->pageTableRoot = -1;
+    }
+    for (int vpn = 0; demandPaging && vpn < p->pageCount; vpn++) {
+        recordPageReference(pageKey(processID, vpn) | REFERENCE_REMOVED);
+    }
+    tlbInvalidateProcess(processID);
+    p->pageCount = 0;
+    p->mappedPages = 0;
+    p->size = 0;
+}
+
+void displayPageTable(int processID) {
+    if (processes[processID].pageCount == 0) {
+        printf("No pages allocated for process %d\n", processID);
+        return;
+    }
+    
+    printf("\nPage Table for Process %d:\n", processID);
+    printf("Page  Frame\n");
+    printf("----  -----\n");
+    
+    for (int i = 0; i < processes[processID].pageCount; i++) {
+        int entry = lookupPage(&processes[processID], i);
+        if (entry >= 0) {
+            printf("%4d  %5d\n", i, entry);
+        } else if (entry == -1) {
+            printf("%4d  %5s\n", i, "-");
+        } else {
+            printf("%4d  swap %d\n", i, -2 - entry);
+        }
+    }
+}
+
+void displayPagingMemory() {
+    int *owners = allocArray(frameMap.frames * sizeof(int));
+    if (!owners) {
+        printf("Out of memory listing %d frames!\n", frameMap.frames);
+        return;
+    }
+    printf("\nPaging Memory Status (Frame Allocation):\n");
+    printf("Frame  Process\n");
+    printf("-----  -------\n");
+    for (int i = 0; i < frameMap.frames; i++) {
+        owners[i] = -1;
+    }
+    for (int pid = 0; pid < maxProcesses; pid++) {
+        int pages = processes[pid].mappedPages > processes[pid].pageCount ? processes[pid].mappedPages
+                                                                          : processes[pid].pageCount;
+        for (int i = 0; i < pages; i++) {
+            int frame = lookupPage(&processes[pid], i);
+            if (frame >= 0) owners[frame] = pid;
+        }
+        for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+            Segment *s = &processes[pid].segments[seg];
+            for (int vpn = 0; vpn < s->pageCount; vpn++) {
+                owners[ptEntries[walkPageTable(&s->pageTableRoot, vpn, false, NULL)]] = pid;
+            }
+        }
+    }
+    for (int i = 0; i < frameMap.frames; i++) {
+        printf("%5d  %7d\n", i, owners[i]);
+    }
+    freeArray(owners);
+}
+
+bool initializeSegmentation() {
+    if (!initializeArena(&segmentArena, segmentPolicy, memorySize)) return false;
+    for (int i = 0; i < maxProcesses; i++) {
+        for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+            processes[i].segments[seg].block = -1;
+            processes[i].segments[seg].limit = 0;
+            processes[i].segments[seg].protection = 0;
+            processes[i].segments[seg].pageTableRoot = -1;
+            processes[i].segments[seg].pageCount = 0;
+        }
+    }
+    segmentGrowthsInPlace = segmentRelocations = segmentBytesCopied = 0;
+    segmentTranslations = segmentFaults = protectionFaults = 0;
+    segmentWalkReferences = segmentCycles = 0;
+    pagedSegmentRequests = pagedSegmentSuccesses = 0;
+    return true;
+}
+
+// Paged segments grow by mapping more frames into the segment's page table, so
+// they never need contiguous memory or relocation; only the tail of the last
+// page is wasted.
+bool growPagedSegment(int processID, int seg, long limit) {
+    Segment *s = &processes[processID].segments[seg];
+    long pages = (limit + pageSize - 1) / pageSize;
+    pagedSegmentRequests++;
+    if (pages > maxVirtualPages() || pages - s->pageCount > frameMap.freeFrames) {
+        if (verbose) printf("  Not enough frames for %ld pages of %s segment of process %d\n",
+                            pages, segmentNames[seg], processID);
+        return false;
+    }
+    int pageCount = s->pageCount;
+    for (; s->pageCount < pages; s->pageCount++) {
+        long slot = walkPageTable(&s->pageTableRoot, s->pageCount, true, NULL);
+        if (slot == -1) {
+            // Give back the frames this call mapped, and the table of a new segment.
+            for (int vpn = pageCount; vpn < s->pageCount; vpn++) {
+                long mapped = walkPageTable(&s->pageTableRoot, vpn, false, NULL);
+                releaseFrameBit(&frameMap, ptEntries[mapped]);
+                ptEntries[mapped] = -1;
+            }
+            if (pageCount == 0 && s->pageTableRoot != -1) {
+                freePageTableNodes(s->pageTableRoot, pageTableLevels - 1);
+                s->pageTableRoot = -1;
+            }
+            if (verbose) printf("  Out of page-table memory, released %d frames\n", s->pageCount - pageCount);
+            s->pageCount = pageCount;
+            return false;
+        }
+        int frame = nextFreeFrame(&frameMap, 0);
+        claimFrameBit(&frameMap, frame);
+        ptEntries[slot] = frame;
+        if (verbose) printf("  Mapped page %d of %s segment of process %d to frame %d\n",
+                            s->pageCount, segmentNames[seg], processID, frame);
+    }
+    if (s->limit == 0) s->protection = segmentProtection[seg];
+    s->limit = limit;
+    pagedSegmentSuccesses++;
+    return true;
+}
+
+// Resizes a segment to limit bytes: within its block or into the free block
+// after it when there is room, otherwise by copying it to a new block.
+bool growSegment(int processID, int seg, long limit) {
+    MemoryManager *m = &segmentArena;
+    Segment *s = &processes[processID].segments[seg];
+    int next = m->memory[s->block].next;
+    long available = m->memory[s->block].size;
+    if (m->algorithm != BUDDY_SYSTEM && next != -1 && !m->memory[next].allocated) {
+        available += m->memory[next].size;
+    }
+
+    if (available >= limit) {
+        Block *b = &m->memory[s->block];
+        m->internalBytes -= b->size - b->requested;
+        if (b->size < limit) {
+            unindexFreeBlock(m, next);
+            mergeWithNext(m, s->block);
+            if (m->memory[s->block].size > limit) {
+                int rest = splitBlock(m, s->block, limit);
+                if (rest != -1) indexFreeBlock(m, rest);
+            }
+        }
+        b = &m->memory[s->block];
+        b->requested = limit;
+        m->internalBytes += b->size - limit;
+        m->totalRequests++;
+        m->successfulAllocations++;
+        segmentGrowthsInPlace++;
+        s->limit = limit;
+        if (verbose) printf("  Grew %s segment of process %d in place to %ld bytes\n",
+                            segmentNames[seg], processID, limit);
+        return true;
+    }
+
+    int index = allocateBlock(m, limit, "Segmentation", processID);
+    if (index == -1) return false;
+    if (verbose) printf("  Moved %s segment of process %d from %ld to %ld\n", segmentNames[seg], processID,
+                        m->memory[s->block].start, m->memory[index].start);
+    segmentRelocations++;
+    segmentBytesCopied += s->limit;
+    freeBlock(m, s->block);
+    s->block = index;
+    s->limit = limit;
+    return true;
+}
+
+// Creates the segment, or grows it by size bytes if the process already has it.
+bool allocateSegment(int processID, int seg, long size) {
+    Segment *s = &processes[processID].segments[seg];
+    if (verbose) printf("\nAllocating %ld bytes of %s segment for process %d using %s\n", size, segmentNames[seg],
+                        processID, pagedSegments ? "paging" : algorithmNames[segmentArena.algorithm]);
+    processes[processID].processID = processID;
+    if (pagedSegments) {
+        return growPagedSegment(processID, seg, s->limit + size);
+    }
+    if (s->block != -1) {
+        if (s->limit + size > segmentArena.arenaSize) {
+            if (verbose) printf("  %s segment of process %d cannot grow past %ld bytes\n",
+                                segmentNames[seg], processID, segmentArena.arenaSize);
+            segmentArena.totalRequests++;
+            segmentArena.failedAllocations++;
+            return false;
+        }
+        return growSegment(processID, seg, s->limit + size);
+    }
+    int index = allocateBlock(&segmentArena, size, "Segmentation", processID);
+    if (index == -1) return false;
+    s->block = index;
+    s->limit = size;
+    s->protection = segmentProtection[seg];
+    return true;
+}
+
+void deallocateSegment(int processID) {
+    bool found = false;
+    if (verbose) printf("\nDeallocating segments for process %d\n", processID);
+    for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+        Segment *s = &processes[processID].segments[seg];
+        if (s->limit == 0) continue;
+        if (s->pageTableRoot != -1) {
+            if (verbose) printf("  Freed %s segment (%d pages) for process %d\n",
+                                segmentNames[seg], s->pageCount, processID);
+            freePageTableTree(s->pageTableRoot, pageTableLevels - 1, processID, 0, NULL);
+            s->pageTableRoot = -1;
+            s->pageCount = 0;
+        } else {
+            if (verbose) printf("  Freed %s segment at %ld (%ld bytes) for process %d\n", segmentNames[seg],
+                                segmentArena.memory[s->block].start, s->limit, processID);
+            freeBlock(&segmentArena, s->block);
+            s->block = -1;
+        }
+        s->limit = 0;
+        found = true;
+    }
+    if (!found && verbose) {
+        printf("  No segments found for process %d\n", processID);
+    }
+}
+
+// Checks the offset against the segment's limit and the access against its
+// protection bits. Returns the physical address, or -1 on a segmentation fault.
+long translateSegment(int processID, int seg, long offset, int access) {
+    Segment *s = &processes[processID].segments[seg];
+    segmentTranslations++;
+    if (s->limit == 0 || offset < 0 || offset >= s->limit) {
+        segmentFaults++;
+        if (verbose) printf("  Segmentation fault: offset %ld outside %s segment of process %d\n",
+                            offset, segmentNames[seg], processID);
+        return -1;
+    }
+    if ((s->protection & access) != access) {
+        protectionFaults++;
+        if (verbose) printf("  Protection fault: %s segment of process %d does not allow that access\n",
+                            segmentNames[seg], processID);
+        return -1;
+    }
+    if (s->pageTableRoot == -1) {
+        long address = segmentArena.memory[s->block].start + offset;
+        segmentCycles += TLB_HIT_CYCLES; // Base plus offset from the segment register
+        if (verbose) printf("  %s:%ld of process %d -> %ld\n", segmentNames[seg], offset, processID, address);
+        return address;
+    }
+    int references = 0;
+    long slot = walkPageTable(&s->pageTableRoot, (int)(offset / pageSize), false, &references);
+    long address = (long)ptEntries[slot] * pageSize + offset % pageSize;
+    segmentWalkReferences += references;
+    segmentCycles += TLB_HIT_CYCLES + (long)references * MEMORY_ACCESS_CYCLES;
+    if (verbose) printf("  %s:%ld of process %d -> %ld (%d-level walk)\n",
+                        segmentNames[seg], offset, processID, address, references);
+    return address;
+}
+
+void displaySegments(int processID) {
+    if (pagedSegments) {
+        printf("\nSegment Table for Process %d (paged):\n", processID);
+        printf("Segment  Limit  Prot  Frames\n");
+        printf("-------  -----  ----  ------\n");
+        for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+            Segment *s = &processes[processID].segments[seg];
+            printf("%-7s  %5ld  %c%c%c ", segmentNames[seg], s->limit,
+                   s->protection & SEG_READ ? 'r' : '-', s->protection & SEG_WRITE ? 'w' : '-',
+                   s->protection & SEG_EXEC ? 'x' : '-');
+            for (int vpn = 0; vpn < s->pageCount; vpn++) {
+                printf(" %d", ptEntries[walkPageTable(&s->pageTableRoot, vpn, false, NULL)]);
+            }
+            printf("\n");
+        }
+        return;
+    }
+    printf("\nSegment Table for Process %d:\n", processID);
+    printf("Segment  Base  Limit  Prot\n");
+    printf("-------  ----  -----  ----\n");
+    for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+        Segment *s = &processes[processID].segments[seg];
+        if (s->block == -1) {
+            printf("%-7s  %4s  %5s  %4s\n", segmentNames[seg], "-", "-", "-");
+            continue;
+        }
+        printf("%-7s  %4ld  %5ld  %c%c%c\n", segmentNames[seg], segmentArena.memory[s->block].start, s->limit,
+               s->protection & SEG_READ ? 'r' : '-', s->protection & SEG_WRITE ? 'w' : '-',
+               s->protection & SEG_EXEC ? 'x' : '-');
+    }
+}
+
+// Bytes mapped for paged segments and the bytes the segments actually use.
+void pagedSegmentUsage(long *mapped, long *used) {
+    *mapped = *used = 0;
+    for (int i = 0; i < maxProcesses; i++) {
+        for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+            *mapped += (long)processes[i].segments[seg].pageCount * pageSize;
+            if (processes[i].segments[seg].pageTableRoot != -1) *used += processes[i].segments[seg].limit;
+        }
+    }
+}
+
+void showSegmentationStats() {
+    if (pagedSegments) {
+        long mapped, used;
+        pagedSegmentUsage(&mapped, &used);
+        printf("\nSegmentation (paged, page size %d):\n", pageSize);
+        printf("  Mapped: %ld bytes  used: %ld  internal fragmentation: %ld bytes\n", mapped, used, mapped - used);
+    } else {
+        printf("\nSegmentation (%s placement):\n", algorithmNames[segmentArena.algorithm]);
+        printf("  Grown in place: %ld  relocated: %ld (%ld bytes copied)\n",
+               segmentGrowthsInPlace, segmentRelocations, segmentBytesCopied);
+    }
+    printf("  Translations: %ld  segmentation faults: %ld  protection faults: %ld\n",
+           segmentTranslations, segmentFaults, protectionFaults);
+    printf("  Walk references: %ld  avg cycles/translation: %.1f\n", segmentWalkReferences,
+           segmentTranslations ? segmentCycles / (double)segmentTranslations : 0.0);
+}
+
+void showCompactionStats() {
+    if (compactionMode == COMPACT_OFF) return;
+    printf("\nCompaction (%s", compactionNames[compactionMode]);
+    if (compactionMode == COMPACT_BUDGETED) printf(", %ld bytes per step", compactionBudget);
+    if (compactionThreshold > 0) printf(", threshold %.1f%%", compactionThreshold);
+    printf("):\n");
+    printf("Technique           Steps      Bytes moved  Time (ms)  Rescued allocations\n");
+    for (int i = 0; i < ALGORITHMS; i++) {
+        if (i == BUDDY_SYSTEM) continue;
+        printf("%-18s  %-9ld  %-11ld  %-9.3f  %d\n", algorithmNames[i], managers[i].compactions,
+               managers[i].bytesMoved, managers[i].compactionNanos / 1e6, managers[i].compactionRescues);
+    }
+}
+
+#define TECHNIQUES (ALGORITHMS + 2) // The partition managers, paging and segmentation
+
+typedef struct {
+    long allocated;
+    long free;
+    float fragmentation;
+    float internalFragmentation; // % of the allocated units that were not requested
+    float successRate;
+} TechniqueUsage;
+
+const char *techniqueName(int technique) {
+    if (technique < ALGORITHMS) return algorithmNames[technique];
+    if (technique == ALGORITHMS) return "Paging";
+    return pagedSegments ? "Paged Segmentation" : "Segmentation";
+}
+
+// Fills in one row of the statistics table.
+void techniqueUsage(int technique, TechniqueUsage *u) {
+    if (technique == ALGORITHMS) {
+        long segmentMapped, segmentUsed;
+        pagedSegmentUsage(&segmentMapped, &segmentUsed);
+        u->allocated = (long)(frameMap.frames - frameMap.freeFrames) * pageSize - segmentMapped;
+        u->free = (long)frameMap.freeFrames * pageSize;
+        u->fragmentation = 0;
+        // Internal: the unrequested tails of the last (or a rounded-up huge) page.
+        long reserved = 0, requested = 0;
+        for (int i = 0; i < maxProcesses; i++) {
+            Process *p = &processes[i];
+            reserved += (long)(p->mappedPages > p->pageCount ? p->mappedPages : p->pageCount) * pageSize;
+            requested += p->size;
+        }
+        u->internalFragmentation = reserved > 0 ? (reserved - requested) * 100.0f / reserved : 0;
+        u->successRate = 100;
+        return;
+    }
+    if (technique > ALGORITHMS && pagedSegments) {
+        long segmentMapped, segmentUsed;
+        pagedSegmentUsage(&segmentMapped, &segmentUsed);
+        u->allocated = segmentMapped;
+        u->free = (long)frameMap.freeFrames * pageSize;
+        u->fragmentation = segmentMapped > 0 ? (segmentMapped - segmentUsed) * 100.0f / segmentMapped : 0;
+        u->internalFragmentation = u->fragmentation;
+        u->successRate = pagedSegmentRequests > 0 ? pagedSegmentSuccesses * 100.0f / pagedSegmentRequests : 0;
+        return;
+    }
+    MemoryManager *m = technique < ALGORITHMS ? &managers[technique] : &segmentArena;
+    long allocated, freeMemory, fragmentedSize;
+    computeUsage(m, &allocated, &freeMemory, &fragmentedSize);
+    u->allocated = allocated;
+    u->free = freeMemory;
+    u->fragmentation = freeMemory > 0 ? (fragmentedSize / (float)freeMemory) * 100 : 0;
+    if (m == &segmentArena) {
+        // Kept as the small-fragment count scaled by the threshold, which is what
+        // the Segmentation row has always reported.
+        u->fragmentation = freeMemory > 0 ? (m->smallFragments * fragThreshold / (float)freeMemory) * 100 : 0;
+    }
+    u->internalFragmentation = allocated > 0 ? m->internalBytes * 100.0f / allocated : 0;
+    u->successRate = m->totalRequests > 0 ? (m->successfulAllocations / (float)m->totalRequests) * 100 : 0;
+}
+
+void showFreeSpaceStats() {
+    printf("\nFree Space:\n");
+    printf("Technique           Blocks  Largest  Small  Free blocks by size (2^k: count)\n");
+    for (int t = 0; t < TECHNIQUES; t++) {
+        if (t == ALGORITHMS || (t > ALGORITHMS && pagedSegments)) continue;
+        MemoryManager *m = t < ALGORITHMS ? &managers[t] : &segmentArena;
+        printf("%-18s  %-6d  %-7ld  %-5d ", techniqueName(t), m->freeBlocks, largestFreeSize(m), m->smallFragments);
+        for (int k = 0; k < FREE_HISTOGRAM_BUCKETS; k++) {
+            if (m->freeHistogram[k]) printf(" %d:%d", k, m->freeHistogram[k]);
+        }
+        printf("\n");
+    }
+}
+
+void saveStatistics() {
+    FILE *file = fopen("memory_stats.txt", "w");
+    if (!file) {
+        printf("Error opening file!\n");
+        return;
+    }
+
+    fprintf(file, "Memory Management Technique,Allocated,Free,Fragmentation,InternalFragmentation,SuccessRate,ExtraInfo\n");
+
+    for (int t = 0; t < TECHNIQUES; t++) {
+        TechniqueUsage u;
+        techniqueUsage(t, &u);
+        const char *extraInfo = t < ALGORITHMS ? "Dynamic Partitioning"
+                              : t == ALGORITHMS ? "Frame Utilization"
+                              : pagedSegments ? "Internal Fragmentation" : "External Fragmentation";
+        fprintf(file, "%s,%ld,%ld,%.2f,%.2f,%.2f,%s\n", techniqueName(t), u.allocated, u.free, u.fragmentation,
+                u.internalFragmentation, u.successRate, extraInfo);
+
+        if (t == ALGORITHMS - 1) {
+            for (int a = 0; a < ALGORITHMS && numaNodes; a++) {
+                NumaArena *n = &numaArenas[a];
+                long freeBytes, fragmentedBytes, internalBytes = 0;
+                numaUsage(n, &freeBytes, &fragmentedBytes);
+                for (int node = 0; node < numaNodes; node++) internalBytes += n->nodes[node].internalBytes;
+                long placed = n->localBytes + n->remoteBytes;
+                long allocated = numaNodes * memorySize - freeBytes;
+                fprintf(file, "NUMA %s,%ld,%ld,%.2f,%.2f,%.2f,Avg Distance %.2f\n", algorithmNames[a],
+                        allocated, freeBytes, freeBytes ? fragmentedBytes * 100.0 / freeBytes : 0.0,
+                        allocated ? internalBytes * 100.0 / allocated : 0.0,
+                        n->requests ? n->successes * 100.0 / n->requests : 0.0,
+                        placed ? n->weightedCost / (double)placed : 0.0);
+            }
+        }
+        if (t == ALGORITHMS && demandPaging) {
+            simulateOptimal(&shadowPolicies[POLICY_OPT]);
+            for (int i = 0; i < REPLACEMENT_POLICIES; i++) {
+                ReplacementState *r = &shadowPolicies[i];
+                long references = r->hits + r->faults;
+                fprintf(file, "Paging %s,%ld,%ld,%.2f,%.2f,%.2f,Fault Rate %.2f%%\n",
+                        replacementNames[i], (long)r->resident * pageSize, (long)(r->capacity - r->resident) * pageSize, 0.0, 0.0,
+                        references ? r->hits * 100.0 / references : 0.0,
+                        references ? r->faults * 100.0 / references : 0.0);
+            }
+        }
+    }
+
+    fclose(file);
+    printf("\nStatistics saved to memory_stats.txt\n");
+}
+
+void showCurrentStats() {
+    printf("\nCurrent Statistics:\n");
+    printf("Technique           Allocated  Free     Fragmentation  Internal  Success\n");
+    printf("------------------  ---------  -------  ------------  --------  -------\n");
+    
+    for (int t = 0; t < TECHNIQUES; t++) {
+        TechniqueUsage u;
+        techniqueUsage(t, &u);
+        printf("%-18s  %6ld    %6ld    %6.1f%%       %5.1f%%    %5.1f%%\n",
+               techniqueName(t), u.allocated, u.free, u.fragmentation, u.internalFragmentation, u.successRate);
+    }
+
+    showFreeSpaceStats();
+    showNumaStats();
+    showCompactionStats();
+    showSegmentationStats();
+    showTranslationStats();
+    showHugePageStats();
+    showDemandPagingStats();
+}
+
+// Streaming metrics: every sampleEvery operations and/or sampleMillis ms the
+// per-technique rows of showCurrentStats() are copied into a ring buffer,
+// which is appended to metricsPath (one CSV row per technique and sample)
+// and flushed whenever it fills, so the file can be plotted mid-run.
+#define METRIC_RING_SIZE 256
+#define METRIC_CLOCK_INTERVAL 64 // Operations between clock reads for time-based sampling
+
+typedef struct {
+    long operation;
+    double seconds;
+    TechniqueUsage usage[TECHNIQUES];
+} MetricSample;
+
+long sampleEvery; // 0 disables operation-based sampling
+long sampleMillis; // 0 disables time-based sampling
+const char *metricsPath = "memory_timeseries.csv";
+FILE *metricsFile;
+MetricSample *metricRing;
+int metricHead, metricCount;
+long metricOperations;
+uint64_t metricStart, nextSampleNanos;
+
+
+void flushMetrics() {
+    for (; metricCount > 0; metricCount--) {
+        MetricSample *s = &metricRing[(metricHead - metricCount + METRIC_RING_SIZE) % METRIC_RING_SIZE];
+        for (int t = 0; t < TECHNIQUES; t++) {
+            fprintf(metricsFile, "%ld,%.3f,%s,%ld,%ld,%.2f,%.2f,%.2f\n", s->operation, s->seconds, techniqueName(t),
+                    s->usage[t].allocated, s->usage[t].free, s->usage[t].fragmentation,
+                    s->usage[t].internalFragmentation, s->usage[t].successRate);
+        }
+    }
+    fflush(metricsFile);
+}
+
+bool startMetrics() {
+    if (sampleEvery == 0 && sampleMillis == 0) return true;
+    metricsFile = fopen(metricsPath, "w");
+    if (!metricsFile) {
+        printf("Error opening file %s!\n", metricsPath);
+        return false;
+    }
+    fprintf(metricsFile, "Operation,Seconds,Technique,Allocated,Free,Fragmentation,InternalFragmentation,SuccessRate\n");
+    metricRing = allocArray(METRIC_RING_SIZE * sizeof(MetricSample));
+    if (!metricRing) {
+        printf("Out of memory for the metrics buffer!\n");
+        fclose(metricsFile);
+        metricsFile = NULL;
+        return false;
+    }
+    metricHead = metricCount = 0;
+    metricOperations = 0;
+    metricStart = nowNanos();
+    nextSampleNanos = metricStart + sampleMillis * 1000000ull;
+    return true;
+}
+
+void takeSample() {
+    MetricSample *s = &metricRing[metricHead];
+    s->operation = metricOperations;
+    s->seconds = (nowNanos() - metricStart) / 1e9;
+    for (int t = 0; t < TECHNIQUES; t++) {
+        techniqueUsage(t, &s->usage[t]);
+    }
+    metricHead = (metricHead + 1) % METRIC_RING_SIZE;
+    if (++metricCount == METRIC_RING_SIZE) flushMetrics();
+}
+
+// Counts one operation and samples when either trigger is due.
+void metricsTick() {
+    if (!metricsFile) return;
+    metricOperations++;
+    bool due = sampleEvery > 0 && metricOperations % sampleEvery == 0;
+    if (!due && sampleMillis > 0 && metricOperations % METRIC_CLOCK_INTERVAL == 0) {
+        uint64_t now = nowNanos();
+        if (now >= nextSampleNanos) {
+            due = true;
+            nextSampleNanos = now + sampleMillis * 1000000ull;
+        }
+    }
+    if (due) takeSample();
+}
+
+void stopMetrics() {
+    if (!metricsFile) return;
+    takeSample();
+    flushMetrics();
+    fclose(metricsFile);
+    metricsFile = NULL;
+    freeArray(metricRing);
+    printf("Time series saved to %s\n", metricsPath);
+}
+
+// Snapshots: the whole simulator state in one file. The header holds the
+// settings, counters and fixed-size structs; every array they point to is
+// stored after it at a 64-byte aligned offset, and the stored pointers are
+// those offsets. Everything inside the arrays is already handle-based, so a
+// restore maps the file privately and only rewrites the top-level pointers:
+// reopening costs the same for any arena, and pages are copied (on write) only
+// as a run touches them. The file itself is never modified, so any number of
+// runs can branch from one snapshot and save their own.
+#define SNAPSHOT_MAGIC "MSNAP04"
+#define SNAPSHOT_ALIGN 64
+
+// Settings and counters saved by value; a restore replaces the command line's.
+int *const snapshotInts[] = {
+    &pageSize, &pageTableLevels, &pageTableBits, &tlbSets, &tlbWays, &segmentPolicy, &swapPages,
+    &hugePageLevel, &nextProcessID, &maxProcesses, &fragThreshold, &sizeClassCount, &ptNodeCapacity,
+    &ptNodeCount, &ptNodesInUse, &ptFreeNodes, (int *)&hugePageMode, (int *)&compactionMode,
+};
+bool *const snapshotFlags[] = {&demandPaging, &pagedSegments, &contiguousPages, &useFreeIndex, &referencesDropped};
+long *const snapshotLongs[] = {
+    &translations, &tlbHits, &tlbMisses, &tlbEvictions, &translationFaults, &pageWalks, &walkReferences,
+    &translationCycles, &segmentGrowthsInPlace, &segmentRelocations, &segmentBytesCopied, &segmentTranslations,
+    &segmentFaults, &protectionFaults, &segmentWalkReferences, &segmentCycles, &pagedSegmentRequests,
+    &pagedSegmentSuccesses, &referenceCount, &referenceCapacity, &pageFaults, &zeroFills, &swapIns, &swapOuts,
+    &outOfMemoryFaults, &compactionBudget, &hugePromotions, &hugePromotionsInPlace, &hugeBytesCopied,
+    &hugeDemotions, &hugeFallbacks, &memorySize, &requestAlignment,
+};
+#define SNAPSHOT_INTS (int)(sizeof(snapshotInts) / sizeof(snapshotInts[0]))
+#define SNAPSHOT_FLAGS (int)(sizeof(snapshotFlags) / sizeof(snapshotFlags[0]))
+#define SNAPSHOT_LONGS (int)(sizeof(snapshotLongs) / sizeof(snapshotLongs[0]))
+
+typedef struct {
+    char magic[8];
+    uint64_t headerSize; // Catches a snapshot from a build with different structs
+    uint64_t size;
+    int ints[SNAPSHOT_INTS];
+    bool flags[SNAPSHOT_FLAGS];
+    long longs[SNAPSHOT_LONGS];
+    float compactionThreshold;
+    unsigned long tlbClock;
+    long sizeClassTable[MAX_SIZE_CLASS_TABLE];
+    MemoryManager managers[ALGORITHMS];
+    MemoryManager segmentArena;
+    FrameBitmap frameMap;
+    FrameBitmap swapMap;
+    ReplacementState pagingPolicy;
+    ReplacementState shadowPolicies[REPLACEMENT_POLICIES];
+    uint64_t ptEntries; // Offsets of the arrays that are not inside a struct above
+    uint64_t tlb;
+    uint64_t pageReferences;
+    uint64_t processes;
+} SnapshotHeader;
+
+// Appends an array and returns its offset, or 0 for an empty one.
+uint64_t snapshotArray(FILE *file, const void *data, size_t bytes) {
+    if (!data || bytes == 0) return 0;
+    long offset = (ftell(file) + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+    fseek(file, offset, SEEK_SET);
+    fwrite(data, 1, bytes, file);
+    return offset;
+}
+
+// The pointer fields of the saved structs carry offsets into the file.
+void *offsetPointer(uint64_t offset) {
+    return (void *)(uintptr_t)offset;
+}
+
+void *snapshotPointer(void *stored) {
+    return stored ? snapshotBase + (uintptr_t)stored : NULL;
+}
+
+void saveManager(FILE *file, MemoryManager *stored, const MemoryManager *m) {
+    *stored = *m;
+    stored->memory = offsetPointer(snapshotArray(file, m->memory, m->capacity * sizeof(Block)));
+    stored->owners.keys = offsetPointer(snapshotArray(file, m->owners.keys, m->owners.capacity * sizeof(uint64_t)));
+    stored->owners.values = offsetPointer(snapshotArray(file, m->owners.values, m->owners.capacity * sizeof(long)));
+}
+
+// Level 0 is saved only up to the words written so far.
+void saveFrameBitmap(FILE *file, FrameBitmap *stored, const FrameBitmap *fb) {
+    *stored = *fb;
+    for (int l = 0; l < fb->levelCount; l++) {
+        int words = l == 0 ? fb->readyWords : fb->words[l];
+        stored->levels[l] = offsetPointer(snapshotArray(file, fb->levels[l], (words ? words : 1) * sizeof(uint64_t)));
+    }
+}
+
+// Only the nodes in use are saved; the restored pool grows from there.
+void saveReplacement(FILE *file, ReplacementState *stored, const ReplacementState *r) {
+    *stored = *r;
+    stored->nodeCapacity = r->nodeCount;
+    stored->nodes = offsetPointer(snapshotArray(file, r->nodes, r->nodeCount * sizeof(PageNode)));
+    stored->index.keys = offsetPointer(snapshotArray(file, r->index.keys, r->index.capacity * sizeof(uint64_t)));
+    stored->index.values = offsetPointer(snapshotArray(file, r->index.values, r->index.capacity * sizeof(long)));
+}
+
+bool saveSnapshot(const char *path) {
+    uint64_t start = nowNanos();
+    SnapshotHeader *h = calloc(1, sizeof(SnapshotHeader)); // Before the file, so a failure leaves none
+    if (!h) {
+        printf("Out of memory saving snapshot %s!\n", path);
+        return false;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("Error opening file %s!\n", path);
+        free(h);
+        return false;
+    }
+    memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+    h->headerSize = sizeof(SnapshotHeader);
+    fwrite(h, sizeof(SnapshotHeader), 1, file); // Rewritten once the offsets are known
+
+    for (int i = 0; i < SNAPSHOT_INTS; i++) h->ints[i] = *snapshotInts[i];
+    for (int i = 0; i < SNAPSHOT_FLAGS; i++) h->flags[i] = *snapshotFlags[i];
+    for (int i = 0; i < SNAPSHOT_LONGS; i++) h->longs[i] = *snapshotLongs[i];
+    h->compactionThreshold = compactionThreshold;
+    h->tlbClock = tlbClock;
+    memcpy(h->sizeClassTable, sizeClassTable, sizeof(sizeClassTable));
+    for (int i = 0; i < ALGORITHMS; i++) {
+        saveManager(file, &h->managers[i], &managers[i]);
+    }
+    saveManager(file, &h->segmentArena, &segmentArena);
+    saveFrameBitmap(file, &h->frameMap, &frameMap);
+    if (demandPaging) {
+        saveFrameBitmap(file, &h->swapMap, &swapMap);
+        saveReplacement(file, &h->pagingPolicy, &pagingPolicy);
+        for (int i = 0; i < REPLACEMENT_POLICIES; i++) {
+            saveReplacement(file, &h->shadowPolicies[i], &shadowPolicies[i]);
+        }
+        h->pageReferences = snapshotArray(file, pageReferences, referenceCount * sizeof(uint64_t));
+    }
+    // Like the policy nodes, the page-table pool is cut down to the nodes ever used.
+    h->ptEntries = snapshotArray(file, ptEntries, (long)ptNodeCount * pageTableFanout() * sizeof(int));
+    h->tlb = snapshotArray(file, tlb, tlbSets * tlbWays * sizeof(TlbEntry));
+    h->processes = snapshotArray(file, processes, maxProcesses * sizeof(Process));
+
+    h->size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    fwrite(h, sizeof(SnapshotHeader), 1, file);
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        printf("Error writing snapshot %s!\n", path);
+    } else {
+        printf("Snapshot saved to %s (%llu bytes) in %.3f ms\n", path, (unsigned long long)h->size,
+               (nowNanos() - start) / 1e6);
+    }
+    free(h);
+    return ok;
+}
+
+void restoreManager(MemoryManager *m, const MemoryManager *stored) {
+    destroyArena(m);
+    *m = *stored;
+    m->memory = snapshotPointer(m->memory);
+    m->owners.keys = snapshotPointer(m->owners.keys);
+    m->owners.values = snapshotPointer(m->owners.values);
+}
+
+// Returns false if level 0 cannot be copied out of the mapping.
+bool restoreFrameBitmap(FrameBitmap *fb, const FrameBitmap *stored) {
+    for (int l = 0; l < fb->levelCount; l++) {
+        freeArray(fb->levels[l]);
+    }
+    *fb = *stored;
+    for (int l = 0; l < fb->levelCount; l++) {
+        fb->levels[l] = snapshotPointer(fb->levels[l]);
+    }
+    // Level 0 is copied out of the mapping so it can keep filling in.
+    fb->levels[0] = resizeArray(fb->levels[0], (fb->readyWords ? fb->readyWords : 1) * sizeof(uint64_t),
+                                (fb->words[0] ? fb->words[0] : 1) * sizeof(uint64_t));
+    return fb->levels[0] != NULL;
+}
+
+void restoreReplacement(ReplacementState *r, const ReplacementState *stored) {
+    freeArray(r->nodes);
+    freeArray(r->index.keys);
+    freeArray(r->index.values);
+    *r = *stored;
+    r->nodes = snapshotPointer(r->nodes);
+    r->index.keys = snapshotPointer(r->index.keys);
+    r->index.values = snapshotPointer(r->index.values);
+}
+
+// Replaces the current state (and settings) with the snapshot's. Restoring a
+// second snapshot is not supported, since arrays of the first may still be in use.
+bool restoreSnapshot(const char *path) {
+    uint64_t start = nowNanos();
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Error opening file %s!\n", path);
+        return false;
+    }
+    struct stat st;
+    SnapshotHeader header;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader) ||
+        pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.headerSize != sizeof(SnapshotHeader) || header.size != (uint64_t)st.st_size) {
+        printf("%s is not a snapshot from this build!\n", path);
+        close(fd);
+        return false;
+    }
+    // MAP_PRIVATE: writes go to private copies of the touched pages, never to the file.
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Error mapping %s!\n", path);
+        return false;
+    }
+    snapshotBase = base;
+    snapshotSize = st.st_size;
+    const SnapshotHeader *h = (const SnapshotHeader *)base;
+
+    for (int i = 0; i < SNAPSHOT_INTS; i++) *snapshotInts[i] = h->ints[i];
+    for (int i = 0; i < SNAPSHOT_FLAGS; i++) *snapshotFlags[i] = h->flags[i];
+    for (int i = 0; i < SNAPSHOT_LONGS; i++) *snapshotLongs[i] = h->longs[i];
+    compactionThreshold = h->compactionThreshold;
+    tlbClock = h->tlbClock;
+    memcpy(sizeClassTable, h->sizeClassTable, sizeof(sizeClassTable));
+    for (int i = 0; i < ALGORITHMS; i++) {
+        restoreManager(&managers[i], &h->managers[i]);
+    }
+    restoreManager(&segmentArena, &h->segmentArena);
+    freeArray(processes);
+    processes = snapshotPointer(offsetPointer(h->processes));
+    bool ok = restoreFrameBitmap(&frameMap, &h->frameMap);
+    if (demandPaging) {
+        ok = restoreFrameBitmap(&swapMap, &h->swapMap) && ok;
+        restoreReplacement(&pagingPolicy, &h->pagingPolicy);
+        for (int i = 0; i < REPLACEMENT_POLICIES; i++) {
+            restoreReplacement(&shadowPolicies[i], &h->shadowPolicies[i]);
+        }
+        freeArray(pageReferences);
+        pageReferences = snapshotPointer(offsetPointer(h->pageReferences));
+        referenceCapacity = referenceCount;
+        optimalReferences = -1;
+    }
+    freeArray(ptEntries);
+    ptEntries = snapshotPointer(offsetPointer(h->ptEntries));
+    ptNodeCapacity = ptNodeCount;
+    freeArray(tlb);
+    tlb = snapshotPointer(offsetPointer(h->tlb));
+    if (!ok) {
+        printf("Out of memory restoring %s!\n", path);
+        return false;
+    }
+    printf("Restored %s (%lld bytes) in %.3f ms\n", path, (long long)st.st_size, (nowNanos() - start) / 1e6);
+    return true;
+}
+
+// Trace replay: drives the same entry points as the menus from a workload file.
+// Text traces hold one event per line, '#' starts a comment:
+//   A <pid> <size> [align]  allocate in every dynamic partition manager, at a
+//                    multiple of align (default --align)
+//   F <pid>          free the process's blocks in every manager
+//   K <pid> <count>  free processes pid..pid+count-1 at once (a teardown storm)
+//   P <pid> <size>   allocate pages
+//   U <pid>          free the process's pages
+//   S <pid> <size> [segment]     create or grow a segment (default heap)
+//   D <pid>                      free the process's segments
+//   R <pid> <vaddr>              translate a virtual address of the process
+//   T <pid> <segment> <offset>   translate a segment offset for reading
+// Segments are named code, data, stack and heap (or numbered 0-3).
+// Binary traces start with TRACE_MAGIC; each record is the op byte, the
+// segment byte for S and T, then the pid and the size as LEB128 varints and,
+// for A, the alignment as one more (0 for the default), so typical events
+// take 3-5 bytes. Version 1 files have no segment byte and version 2 no
+// alignment.
+#define TRACE_MAGIC "MTRACE03"
+#define TRACE_MAGIC_V1 "MTRACE01"
+#define TRACE_MAGIC_V2 "MTRACE02"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_BUFFER_SIZE 65536
+#define TRACE_MAX_RECORD 32
+
+typedef struct {
+    uint8_t op;
+    uint8_t segment;
+    uint32_t processID;
+    uint64_t arg;
+    uint64_t align; // A only; 0 for the default
+} TraceEvent;
+
+typedef struct {
+    FILE *file;
+    bool binary;
+    int version;
+    uint8_t buffer[TRACE_BUFFER_SIZE];
+    size_t count;
+    size_t pos;
+    long line;
+} TraceReader;
+
+bool openTrace(TraceReader *r, const char *path) {
+    char magic[TRACE_MAGIC_LEN];
+    r->file = fopen(path, "rb");
+    if (!r->file) {
+        printf("Error opening trace %s!\n", path);
+        return false;
+    }
+    r->count = 0;
+    r->pos = 0;
+    r->line = 0;
+    r->binary = fread(magic, 1, TRACE_MAGIC_LEN, r->file) == TRACE_MAGIC_LEN &&
+                (memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0 ||
+                 memcmp(magic, TRACE_MAGIC_V1, TRACE_MAGIC_LEN) == 0 ||
+                 memcmp(magic, TRACE_MAGIC_V2, TRACE_MAGIC_LEN) == 0);
+    r->version = !r->binary ? 3 : memcmp(magic, TRACE_MAGIC_V1, TRACE_MAGIC_LEN) == 0 ? 1
+               : memcmp(magic, TRACE_MAGIC_V2, TRACE_MAGIC_LEN) == 0 ? 2 : 3;
+    if (!r->binary) {
+        rewind(r->file);
+    }
+    return true;
+}
+
+void closeTrace(TraceReader *r) {
+    if (r->file) {
+        fclose(r->file);
+        r->file = NULL;
+    }
+}
+
+// Returns false if the buffer ends before the varint does.
+bool readVarint(TraceReader *r, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; r->pos < r->count && shift < 64; shift += 7) {
+        uint8_t byte = r->buffer[r->pos++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+void writeVarint(FILE *out, uint64_t value) {
+    uint8_t bytes[10];
+    int n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n++;
+    } while (value);
+    fwrite(bytes, 1, n, out);
+}
+
+// Reads a segment name or number after optional blanks; an empty field keeps
+// *segment. Returns the position after it, or NULL for an unknown name.
+char *parseSegment(char *p, uint8_t *segment) {
+    while (*p == ' ' || *p == '\t') p++;
+    int length = 0;
+    while (p[length] && p[length] != ' ' && p[length] != '\t' && p[length] != '\n' && p[length] != '\r') {
+        length++;
+    }
+    if (length == 0) return p;
+    for (int seg = 0; seg < SEGMENT_KINDS; seg++) {
+        if ((length == 1 && *p == '0' + seg) ||
+            (length == (int)strlen(segmentNames[seg]) && strncasecmp(p, segmentNames[seg], length) == 0)) {
+            *segment = (uint8_t)seg;
+            return p + length;
+        }
+    }
+    return NULL;
+}
+
+// Returns 1 when an event was read, 0 at end of trace and -1 on a malformed line.
+int readTraceEvent(TraceReader *r, TraceEvent *e) {
+    if (r->binary) {
+        if (r->count - r->pos < TRACE_MAX_RECORD && !feof(r->file)) {
+            memmove(r->buffer, r->buffer + r->pos, r->count - r->pos);
+            r->count -= r->pos;
+            r->pos = 0;
+            r->count += fread(r->buffer + r->count, 1, TRACE_BUFFER_SIZE - r->count, r->file);
+        }
+        if (r->pos >= r->count) return 0;
+        r->line++;
+        e->op = r->buffer[r->pos++];
+        e->segment = SEG_HEAP;
+        if (r->version >= 2 && (e->op == 'S' || e->op == 'T')) {
+            if (r->pos == r->count) return -1; // Truncated record
+            e->segment = r->buffer[r->pos++];
+        }
+        uint64_t processID, align = 0;
+        if (!readVarint(r, &processID) || !readVarint(r, &e->arg) ||
+            (r->version >= 3 && e->op == 'A' && !readVarint(r, &align))) {
+            r->pos = r->count; // Truncated record
+            return -1;
+        }
+        if (processID > INT_MAX) return -1;
+        e->processID = (uint32_t)processID;
+        e->align = align;
+        return 1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), r->file)) {
+        r->line++;
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        char *end;
+        e->op = (uint8_t)*p++;
+        unsigned long processID = strtoul(p, &end, 10);
+        if (end == p || processID > INT_MAX) return -1;
+        e->processID = (uint32_t)processID;
+        p = end;
+        e->segment = SEG_HEAP;
+        if (e->op == 'T' && (p = parseSegment(p, &e->segment)) == NULL) return -1;
+        e->arg = strtoull(p, &end, 10);
+        e->align = e->op == 'A' ? strtoull(end, NULL, 10) : 0;
+        if (e->op == 'S' && parseSegment(end, &e->segment) == NULL) return -1;
+        return 1;
+    }
+    return 0;
+}
+
+bool validTraceSize(uint64_t size) {
+    return size > 0 && size <= (uint64_t)memorySize;
+}
+
+bool validAlignment(uint64_t align) {
+    return align > 0 && align <= (uint64_t)memorySize && (align & (align - 1)) == 0;
+}
+
+bool validTraceProcess(uint32_t processID) {
+    return processID > 0 && processID < (uint32_t)maxProcesses;
+}
+
+// A, F and K carry block owners (object ids from the generator), so any ID that
+// fits an int is valid; larger ones would turn negative and hit the owner sentinels.
+bool validOwnerProcess(uint32_t processID) {
+    return processID <= INT_MAX;
+}
+
+// Applies one event; returns false if the event was rejected as invalid.
+bool applyTraceEvent(const TraceEvent *e) {
+    int processID = (int)e->processID;
+    long size = (long)e->arg;
+
+    switch (e->op) {
+        case 'A': {
+            long align = e->align ? (long)e->align : requestAlignment;
+            if (!validOwnerProcess(e->processID) || !validTraceSize(e->arg) || !validAlignment(align)) {
+                return false;
+            }
+            for (int i = 0; i < ALGORITHMS; i++) {
+                allocateAligned(&managers[i], size, align, algorithmNames[i], processID);
+                if (numaNodes) numaAllocate(&numaArenas[i], i, size, align, processID);
+            }
+            return true;
+        }
+        case 'F':
+            if (!validOwnerProcess(e->processID)) return false;
+            for (int i = 0; i < ALGORITHMS; i++) {
+                deallocate(&managers[i], processID, algorithmNames[i]);
+                if (numaNodes) numaDeallocate(&numaArenas[i], i, processID);
+            }
+            return true;
+        case 'K':
+            if (!validOwnerProcess(e->processID) || e->arg == 0 || e->arg > INT_MAX
+                || e->processID + e->arg - 1 > INT_MAX) {
+                return false;
+            }
+            for (int i = 0; i < ALGORITHMS; i++) {
+                deallocateProcesses(&managers[i], processID, (int)e->arg, algorithmNames[i]);
+                if (numaNodes) numaDeallocateProcesses(&numaArenas[i], i, processID, (int)e->arg);
+            }
+            return true;
+        case 'P':
+            if (!validTraceProcess(e->processID) || !validTraceSize(e->arg)) return false;
+            allocatePages(processID, size);
+            return true;
+        case 'U':
+            if (!validTraceProcess(e->processID)) return false;
+            deallocatePages(processID);
+            return true;
+        case 'S':
+            if (!validTraceProcess(e->processID) || !validTraceSize(e->arg) || e->segment >= SEGMENT_KINDS) {
+                return false;
+            }
+            allocateSegment(processID, e->segment, size);
+            return true;
+        case 'D':
+            if (!validTraceProcess(e->processID)) return false;
+            deallocateSegment(processID);
+            return true;
+        case 'R':
+            if (!validTraceProcess(e->processID)) return false;
+            translate(processID, (long)e->arg);
+            return true;
+        case 'T':
+            if (!validTraceProcess(e->processID) || e->segment >= SEGMENT_KINDS) return false;
+            translateSegment(processID, e->segment, (long)e->arg, SEG_READ);
+            return true;
+        default:
+            return false;
+    }
+}
+
+double elapsedSeconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+bool replayTrace(const char *path) {
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    if (!reader || !openTrace(reader, path)) {
+        free(reader);
+        return false;
+    }
+
+    long events = 0, rejected = 0;
+    long systemAllocations = meta.systemAllocations;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    TraceEvent e;
+    int status;
+    while ((status = readTraceEvent(reader, &e)) != 0) {
+        if (status < 0) {
+            printf("Malformed trace %s %ld\n", reader->binary ? "record" : "line", reader->line);
+            rejected++;
+            continue;
+        }
+        events++;
+        if (!applyTraceEvent(&e)) {
+            rejected++;
+        }
+        metricsTick();
+    }
+    double seconds = elapsedSeconds(&start);
+    closeTrace(reader);
+    free(reader);
+
+    printf("\nReplayed %ld events from %s (%ld rejected) in %.3f s (%.0f events/s)\n",
+           events, path, rejected, seconds, seconds > 0 ? events / seconds : 0.0);
+    showMetaArenaStats(systemAllocations);
+    return true;
+}
+
+void writeTraceEvent(FILE *out, const TraceEvent *e) {
+    fputc(e->op, out);
+    if (e->op == 'S' || e->op == 'T') fputc(e->segment, out);
+    writeVarint(out, e->processID);
+    writeVarint(out, e->arg);
+    if (e->op == 'A') writeVarint(out, e->align);
+}
+
+// Rewrites a trace (text or binary) into the binary format.
+bool convertTrace(const char *inPath, const char *outPath) {
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    if (!reader || !openTrace(reader, inPath)) {
+        free(reader);
+        return false;
+    }
+    FILE *out = fopen(outPath, "wb");
+    if (!out) {
+        printf("Error opening file %s!\n", outPath);
+        closeTrace(reader);
+        free(reader);
+        return false;
+    }
+
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, out);
+    long events = 0;
+    TraceEvent e;
+    int status;
+    while ((status = readTraceEvent(reader, &e)) != 0) {
+        if (status < 0) {
+            printf("Malformed trace %s %ld\n", reader->binary ? "record" : "line", reader->line);
+            continue;
+        }
+        writeTraceEvent(out, &e);
+        events++;
+    }
+    fclose(out);
+    closeTrace(reader);
+    free(reader);
+    printf("Wrote %ld events to %s\n", events, outPath);
+    return true;
+}
+
+// Concurrent replay: a trace is split across worker threads by pid (so each
+// process's events stay in order) and replayed against one shared arena.
+// The baseline serialises every operation on a single global lock. Cached mode
+// serves small requests from per-thread magazines backed by sharded central
+// free lists, only taking the arena lock to carve new spans, and hands out
+// page frames from an atomic bitmap without any lock.
+#define SIZE_CLASS_GRANULE 8
+#define SIZE_CLASSES 32 // Requests up to 256 units go through the caches
+#define MAGAZINE_SIZE 64
+#define TRANSFER_BATCH 32
+#define CENTRAL_SHARDS 8
+#define SPAN_OWNER -2
+#define CONCURRENT_ARENA_SIZE (1 << 24)
+#define MAX_THREAD_COUNTS 16
+#define LIVE_BLOCK -1 // LiveNode kinds besides a size class
+#define LIVE_FRAME -2
+
+typedef struct {
+    pthread_mutex_t lock;
+    long *chunks;
+    int count;
+    int capacity;
+} CentralList;
+
+typedef struct {
+    MemoryManager arena;
+    bool cached;
+    pthread_mutex_t lock; // The whole simulator in baseline mode, span carving otherwise
+    CentralList central[SIZE_CLASSES][CENTRAL_SHARDS];
+    _Atomic uint64_t *frameBitmap;
+    int frameWords;
+    atomic_long spansCarved;
+} SharedArena;
+
+typedef struct {
+    long value; // Block handle, chunk start or frame number
+    int kind;  // Size class, LIVE_BLOCK or LIVE_FRAME
+    int next;
+} LiveNode;
+
+typedef struct {
+    uint32_t processID;
+    bool used;
+    int head;
+} PidSlot;
+
+typedef struct {
+    SharedArena *shared;
+    int id;
+    pthread_t thread;
+    TraceEvent *events;
+    long count;
+    long magazines[SIZE_CLASSES][MAGAZINE_SIZE];
+    int magazineCount[SIZE_CLASSES];
+    PidSlot *slots;
+    int slotCapacity;
+    int slotsUsed;
+    int *scratch;
+    int scratchCapacity;
+    LiveNode *nodes;
+    int nodeCapacity;
+    int nodeCount;
+    int freeNodes;
+    long allocations;
+    long failures;
+} Worker;
+
+// Finds (or creates) the list of live allocations a worker holds for a pid.
+// Returns NULL only if the table cannot be created; a table that fails to grow
+// is still at most half full and stays in use.
+int *workerPidList(Worker *w, uint32_t processID) {
+    if (w->slotsUsed * 2 >= w->slotCapacity) {
+        int capacity = w->slotCapacity ? w->slotCapacity * 2 : 256;
+        PidSlot *slots = allocArray(capacity * sizeof(PidSlot));
+        if (slots) {
+            memset(slots, 0, capacity * sizeof(PidSlot));
+            for (int i = 0; i < w->slotCapacity; i++) {
+                if (!w->slots[i].used) continue;
+                int j = (w->slots[i].processID * 2654435761u) & (capacity - 1);
+                while (slots[j].used) j = (j + 1) & (capacity - 1);
+                slots[j] = w->slots[i];
+            }
+            freeArray(w->slots);
+            w->slots = slots;
+            w->slotCapacity = capacity;
+        } else if (w->slotCapacity == 0) {
+            return NULL;
+        }
+    }
+    int i = (processID * 2654435761u) & (w->slotCapacity - 1);
+    while (w->slots[i].used && w->slots[i].processID != processID) {
+        i = (i + 1) & (w->slotCapacity - 1);
+    }
+    if (!w->slots[i].used) {
+        w->slots[i].used = true;
+        w->slots[i].processID = processID;
+        w->slots[i].head = -1;
+        w->slotsUsed++;
+    }
+    return &w->slots[i].head;
+}
+
+// Adds a live allocation to the pid's list. Returns false if the bookkeeping
+// cannot grow, in which case the caller gives the allocation back.
+bool workerRecord(Worker *w, uint32_t processID, long value, int kind) {
+    int *head = workerPidList(w, processID);
+    if (!head) return false;
+    int node = w->freeNodes;
+    if (node != -1) {
+        w->freeNodes = w->nodes[node].next;
+    } else {
+        if (w->nodeCount == w->nodeCapacity) {
+            int capacity = w->nodeCapacity ? w->nodeCapacity * 2 : 1024;
+            LiveNode *nodes = resizeArray(w->nodes, w->nodeCapacity * sizeof(LiveNode), capacity * sizeof(LiveNode));
+            if (!nodes) return false;
+            w->nodes = nodes;
+            w->nodeCapacity = capacity;
+        }
+        node = w->nodeCount++;
+    }
+    w->nodes[node].value = value;
+    w->nodes[node].kind = kind;
+    w->nodes[node].next = *head;
+    *head = node;
+    return true;
+}
+
+int claimFrame(SharedArena *s, int hint) {
+    for (int k = 0; k < s->frameWords; k++) {
+        int word = (hint + k) % s->frameWords;
+        uint64_t bits = atomic_load_explicit(&s->frameBitmap[word], memory_order_relaxed);
+        while (~bits) {
+            int bit = __builtin_ctzll(~bits);
+            if (atomic_compare_exchange_weak_explicit(&s->frameBitmap[word], &bits, bits | (1ull << bit),
+                                                      memory_order_acquire, memory_order_relaxed)) {
+                return word * 64 + bit;
+            }
+        }
+    }
+    return -1;
+}
+
+void releaseFrame(SharedArena *s, int frame) {
+    atomic_fetch_and_explicit(&s->frameBitmap[frame / 64], ~(1ull << (frame % 64)), memory_order_release);
+}
+
+// Returns false, leaving the list unchanged, if it cannot grow.
+bool centralPush(CentralList *c, const long *chunks, int count) {
+    pthread_mutex_lock(&c->lock);
+    if (c->count + count > c->capacity) {
+        int capacity = (c->count + count) * 2;
+        long *grown = resizeArray(c->chunks, c->capacity * sizeof(long), capacity * sizeof(long));
+        if (!grown) {
+            pthread_mutex_unlock(&c->lock);
+            return false;
+        }
+        c->chunks = grown;
+        c->capacity = capacity;
+    }
+    memcpy(c->chunks + c->count, chunks, count * sizeof(long));
+    c->count += count;
+    pthread_mutex_unlock(&c->lock);
+    return true;
+}
+
+int centralPop(CentralList *c, long *chunks, int max) {
+    pthread_mutex_lock(&c->lock);
+    int count = c->count < max ? c->count : max;
+    c->count -= count;
+    memcpy(chunks, c->chunks + c->count, count * sizeof(long));
+    pthread_mutex_unlock(&c->lock);
+    return count;
+}
+
+// Refills an empty magazine from the central shards, starting with the
+// worker's own, and carves a fresh span from the arena when they are all empty.
+bool refillMagazine(Worker *w, int sizeClass) {
+    SharedArena *s = w->shared;
+    for (int k = 0; k < CENTRAL_SHARDS; k++) {
+        CentralList *c = &s->central[sizeClass][(w->id + k) % CENTRAL_SHARDS];
+        if (__atomic_load_n(&c->count, __ATOMIC_RELAXED) == 0) continue;
+        w->magazineCount[sizeClass] = centralPop(c, w->magazines[sizeClass], TRANSFER_BATCH);
+        if (w->magazineCount[sizeClass] > 0) return true;
+    }
+
+    int objectSize = (sizeClass + 1) * SIZE_CLASS_GRANULE;
+    int objects = MAGAZINE_SIZE;
+    pthread_mutex_lock(&s->lock);
+    int span = allocateBlock(&s->arena, objectSize * objects, "Span", SPAN_OWNER);
+    if (span == -1) {
+        objects = 1;
+        span = allocateBlock(&s->arena, objectSize, "Span", SPAN_OWNER);
+    }
+    long start = span == -1 ? 0 : s->arena.memory[span].start;
+    pthread_mutex_unlock(&s->lock);
+    if (span == -1) return false;
+
+    atomic_fetch_add(&s->spansCarved, 1);
+    for (int i = 0; i < objects; i++) {
+        w->magazines[sizeClass][i] = start + (long)i * objectSize;
+    }
+    w->magazineCount[sizeClass] = objects;
+    return true;
+}
+
+void workerAllocate(Worker *w, uint32_t processID, long size) {
+    SharedArena *s = w->shared;
+    if (s->cached && size <= SIZE_CLASSES * SIZE_CLASS_GRANULE) {
+        int sizeClass = (int)((size - 1) / SIZE_CLASS_GRANULE);
+        if (w->magazineCount[sizeClass] == 0 && !refillMagazine(w, sizeClass)) {
+            w->failures++;
+            return;
+        }
+        if (!workerRecord(w, processID, w->magazines[sizeClass][w->magazineCount[sizeClass] - 1], sizeClass)) {
+            w->failures++;
+            return;
+        }
+        w->magazineCount[sizeClass]--;
+        w->allocations++;
+        return;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    int index = allocateBlock(&s->arena, size, "Shared", (int)processID);
+    pthread_mutex_unlock(&s->lock);
+    if (index == -1) {
+        w->failures++;
+        return;
+    }
+    if (!workerRecord(w, processID, index, LIVE_BLOCK)) {
+        pthread_mutex_lock(&s->lock);
+        freeBlock(&s->arena, index);
+        pthread_mutex_unlock(&s->lock);
+        w->failures++;
+        return;
+    }
+    w->allocations++;
+}
+
+void workerAllocatePages(Worker *w, uint32_t processID, long size) {
+    SharedArena *s = w->shared;
+    int pagesNeeded = (int)((size + pageSize - 1) / pageSize);
+    int claimed = 0;
+    if (pagesNeeded > w->scratchCapacity) {
+        int *scratch = resizeArray(w->scratch, w->scratchCapacity * sizeof(int), pagesNeeded * sizeof(int));
+        if (!scratch) {
+            w->failures++;
+            return;
+        }
+        w->scratch = scratch;
+        w->scratchCapacity = pagesNeeded;
+    }
+    int *claimedFrames = w->scratch;
+
+    if (!s->cached) pthread_mutex_lock(&s->lock);
+    while (claimed < pagesNeeded) {
+        int frame = claimFrame(s, w->id);
+        if (frame == -1) break;
+        claimedFrames[claimed++] = frame;
+    }
+    if (claimed < pagesNeeded) {
+        for (int i = 0; i < claimed; i++) {
+            releaseFrame(s, claimedFrames[i]);
+        }
+    }
+    if (!s->cached) pthread_mutex_unlock(&s->lock);
+
+    if (claimed < pagesNeeded) {
+        w->failures++;
+        return;
+    }
+    for (int i = 0; i < claimed; i++) {
+        if (!workerRecord(w, processID, claimedFrames[i], LIVE_FRAME)) {
+            // Frames already recorded stay with the pid until it frees them.
+            for (int j = i; j < claimed; j++) {
+                releaseFrame(s, claimedFrames[j]);
+            }
+            w->failures++;
+            return;
+        }
+    }
+    w->allocations++;
+}
+
+// A chunk that finds both its magazine and the central list full is dropped
+// and stays unused inside its span.
+void workerFreeChunk(Worker *w, int sizeClass, long start) {
+    if (w->magazineCount[sizeClass] == MAGAZINE_SIZE) {
+        if (!centralPush(&w->shared->central[sizeClass][w->id % CENTRAL_SHARDS],
+                         w->magazines[sizeClass] + MAGAZINE_SIZE - TRANSFER_BATCH, TRANSFER_BATCH)) {
+            return;
+        }
+        w->magazineCount[sizeClass] -= TRANSFER_BATCH;
+    }
+    w->magazines[sizeClass][w->magazineCount[sizeClass]++] = start;
+}
+
+// Frees the pid's blocks (frames == false) or its page frames (frames == true).
+void workerFree(Worker *w, uint32_t processID, bool frames) {
+    SharedArena *s = w->shared;
+    int *link = workerPidList(w, processID);
+    if (!link) return;
+    bool locked = false;
+    while (*link != -1) {
+        int node = *link;
+        LiveNode *n = &w->nodes[node];
+        if ((n->kind == LIVE_FRAME) != frames) {
+            link = &n->next;
+            continue;
+        }
+        if (!locked && (n->kind == LIVE_BLOCK || !s->cached)) {
+            pthread_mutex_lock(&s->lock);
+            locked = true;
+        }
+        if (n->kind == LIVE_FRAME) {
+            releaseFrame(s, (int)n->value);
+        } else if (n->kind == LIVE_BLOCK) {
+            freeBlock(&s->arena, (int)n->value);
+        } else {
+            workerFreeChunk(w, n->kind, n->value);
+        }
+        *link = n->next;
+        n->next = w->freeNodes;
+        w->freeNodes = node;
+    }
+    if (locked) pthread_mutex_unlock(&s->lock);
+}
+
+void *workerMain(void *arg) {
+    Worker *w = arg;
+    long arenaSize = w->shared->arena.arenaSize;
+    for (long i = 0; i < w->count; i++) {
+        const TraceEvent *e = &w->events[i];
+        bool validSize = e->arg > 0 && e->arg <= (uint64_t)arenaSize;
+        switch (e->op) {
+            case 'A':
+            case 'S':
+                if (validSize) workerAllocate(w, e->processID, (long)e->arg);
+                break;
+            case 'F':
+            case 'D':
+                workerFree(w, e->processID, false);
+                break;
+            case 'P':
+                if (validSize) workerAllocatePages(w, e->processID, (long)e->arg);
+                break;
+            case 'U':
+                workerFree(w, e->processID, true);
+                break;
+        }
+    }
+    return NULL;
+}
+
+bool loadTrace(const char *path, TraceEvent **events, long *count) {
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    if (!reader || !openTrace(reader, path)) {
+        free(reader);
+        return false;
+    }
+    long capacity = 1 << 16;
+    *events = malloc(capacity * sizeof(TraceEvent));
+    *count = 0;
+    TraceEvent e;
+    int status;
+    while (*events && (status = readTraceEvent(reader, &e)) != 0) {
+        if (status < 0) continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            TraceEvent *grown = realloc(*events, capacity * sizeof(TraceEvent));
+            if (!grown) {
+                free(*events);
+                *events = NULL;
+                break;
+            }
+            *events = grown;
+        }
+        (*events)[(*count)++] = e;
+    }
+    closeTrace(reader);
+    free(reader);
+    if (!*events) {
+        printf("Out of memory loading %s after %ld events!\n", path, *count);
+        return false;
+    }
+    return true;
+}
+
+// Replays the events on the given number of threads and returns the wall time,
+// or -1 if the workers' event lists cannot be allocated.
+double runConcurrentReplay(SharedArena *s, const TraceEvent *events, long count, int threads,
+                           long *allocations, long *failures) {
+    Worker *workers = calloc(threads, sizeof(Worker));
+    if (!workers) return -1;
+    for (int t = 0; t < threads; t++) {
+        workers[t].shared = s;
+        workers[t].id = t;
+        workers[t].freeNodes = -1;
+    }
+    for (long i = 0; i < count; i++) {
+        workers[events[i].processID % threads].count++;
+    }
+    bool ok = true;
+    for (int t = 0; t < threads; t++) {
+        workers[t].events = malloc((workers[t].count + 1) * sizeof(TraceEvent));
+        workers[t].count = 0;
+        if (!workers[t].events) ok = false;
+    }
+    if (!ok) {
+        for (int t = 0; t < threads; t++) {
+            free(workers[t].events);
+        }
+        free(workers);
+        return -1;
+    }
+    for (long i = 0; i < count; i++) {
+        Worker *w = &workers[events[i].processID % threads];
+        w->events[w->count++] = events[i];
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&workers[t].thread, NULL, workerMain, &workers[t]);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    double seconds = elapsedSeconds(&start);
+
+    *allocations = *failures = 0;
+    for (int t = 0; t < threads; t++) {
+        *allocations += workers[t].allocations;
+        *failures += workers[t].failures;
+        free(workers[t].events);
+        freeArray(workers[t].slots);
+        freeArray(workers[t].scratch);
+        freeArray(workers[t].nodes);
+    }
+    free(workers);
+    return seconds;
+}
+
+// Returns false if the arena cannot be initialized.
+bool resetSharedArena(SharedArena *s, int algorithm, long arenaSize, bool cached) {
+    if (!initializeArena(&s->arena, algorithm, arenaSize)) return false;
+    s->cached = cached;
+    atomic_store(&s->spansCarved, 0);
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        for (int k = 0; k < CENTRAL_SHARDS; k++) {
+            s->central[c][k].count = 0;
+        }
+    }
+    long frames = arenaSize / pageSize;
+    for (int i = 0; i < s->frameWords; i++) {
+        uint64_t padding = 0;
+        if ((i + 1) * 64L > frames) {
+            long valid = frames - i * 64L;
+            padding = valid <= 0 ? ~0ull : ~0ull << valid;
+        }
+        atomic_store(&s->frameBitmap[i], padding);
+    }
+    return true;
+}
+
+bool concurrentBenchmark(const char *path, const int *threadCounts, int runs, int algorithm, long arenaSize) {
+    if (arenaSize / pageSize > INT_MAX) {
+        printf("Arena too large! At most %d frames of %d units\n", INT_MAX, pageSize);
+        return false;
+    }
+    TraceEvent *events;
+    long count;
+    if (!loadTrace(path, &events, &count)) return false;
+
+    long systemAllocations = meta.systemAllocations;
+    SharedArena *s = calloc(1, sizeof(SharedArena));
+    long frameWords = (arenaSize / pageSize + 63) / 64;
+    _Atomic uint64_t *frameBitmap = calloc(frameWords ? frameWords : 1, sizeof(uint64_t));
+    if (!s || !frameBitmap) {
+        printf("Out of memory for the shared arena!\n");
+        free(s);
+        free(frameBitmap);
+        free(events);
+        return false;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        for (int k = 0; k < CENTRAL_SHARDS; k++) {
+            pthread_mutex_init(&s->central[c][k].lock, NULL);
+        }
+    }
+    s->frameWords = (int)frameWords;
+    s->frameBitmap = frameBitmap;
+
+    // Magazines and central lists hold chunk offsets into spans, which would go
+    // stale if compaction slid a span, so the shared arena never compacts.
+    CompactionMode savedCompaction = compactionMode;
+    compactionMode = COMPACT_OFF;
+
+    printf("\nConcurrent replay of %s: %ld events, %s arena of %ld units\n",
+           path, count, algorithmNames[algorithm], arenaSize);
+    printf("Threads  Mode            Seconds      Ops/sec   Allocated    Failed  Spans  Speedup\n");
+    printf("-------  -------------  --------  -----------  ----------  --------  -----  -------\n");
+
+    double baseline = 0;
+    bool ok = true;
+    for (int r = 0; r < runs && ok; r++) {
+        for (int cached = 0; cached <= 1; cached++) {
+            long allocations, failures;
+            if (!resetSharedArena(s, algorithm, arenaSize, cached)) {
+                printf("Out of memory for the shared arena!\n");
+                ok = false;
+                break;
+            }
+            double seconds = runConcurrentReplay(s, events, count, threadCounts[r], &allocations, &failures);
+            if (seconds < 0) {
+                printf("Out of memory for %d workers!\n", threadCounts[r]);
+                ok = false;
+                break;
+            }
+            if (r == 0 && !cached) baseline = seconds;
+            printf("%7d  %-13s  %8.3f  %11.0f  %10ld  %8ld  %5ld  %6.2fx\n",
+                   threadCounts[r], cached ? "Thread caches" : "Global lock", seconds,
+                   seconds > 0 ? count / seconds : 0.0, allocations, failures,
+                   atomic_load(&s->spansCarved), seconds > 0 ? baseline / seconds : 0.0);
+        }
+    }
+    showMetaArenaStats(systemAllocations);
+
+    for (int c = 0; c < SIZE_CLASSES; c++) {
+        for (int k = 0; k < CENTRAL_SHARDS; k++) {
+            pthread_mutex_destroy(&s->central[c][k].lock);
+            freeArray(s->central[c][k].chunks);
+        }
+    }
+    pthread_mutex_destroy(&s->lock);
+    destroyArena(&s->arena);
+    free(s->frameBitmap);
+    free(s);
+    free(events);
+    compactionMode = savedCompaction;
+    return ok;
+}
+
+// Benchmarks: synthetic workloads timed per operation against every fit
+// policy, with latencies kept in HdrHistogram-style log-linear buckets (each
+// power of two split into 2^HISTOGRAM_SUB_BITS sub-buckets, ~6% precision).
+// Bucket 0 holds 0..15 ns exactly; bucket b > 0 holds [16, 32) << (b - 1).
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS 61
+#define BENCH_ARENA_SIZE (1 << 22)
+#define BENCH_OPERATIONS 200000
+#define BENCH_BATCH 512
+#define BENCH_CHURN_LIVE 131072
+#define BENCH_SEED 0x9e3779b97f4a7c15ull
+#define DISPATCH_REPEATS 5
+
+bool pointerDispatch = false; // Bench through allocate() and fitFunctions[] instead
+
+typedef struct {
+    long counts[HISTOGRAM_BUCKETS][HISTOGRAM_SUB_BUCKETS];
+    long total;
+} LatencyHistogram;
+
+typedef enum { SIZES_UNIFORM, SIZES_BIMODAL, SIZES_POWER_LAW, SIZES_MALLOC } SizeDistribution;
+const char *sizeDistributionNames[] = {"uniform", "bimodal", "powerlaw", "malloc"};
+#define SIZE_DISTRIBUTIONS 4
+typedef enum { FREE_LIFO, FREE_FIFO, FREE_RANDOM, FREE_CHURN } FreeOrder;
+
+typedef struct {
+    const char *name;
+    SizeDistribution sizes;
+    FreeOrder order;
+    long operations;
+} BenchWorkload;
+
+const BenchWorkload benchWorkloads[] = {
+    {"uniform-lifo", SIZES_UNIFORM, FREE_LIFO, BENCH_OPERATIONS},
+    {"uniform-fifo", SIZES_UNIFORM, FREE_FIFO, BENCH_OPERATIONS},
+    {"uniform-random", SIZES_UNIFORM, FREE_RANDOM, BENCH_OPERATIONS},
+    {"bimodal-lifo", SIZES_BIMODAL, FREE_LIFO, BENCH_OPERATIONS},
+    {"bimodal-fifo", SIZES_BIMODAL, FREE_FIFO, BENCH_OPERATIONS},
+    {"bimodal-random", SIZES_BIMODAL, FREE_RANDOM, BENCH_OPERATIONS},
+    {"powerlaw-lifo", SIZES_POWER_LAW, FREE_LIFO, BENCH_OPERATIONS},
+    {"powerlaw-fifo", SIZES_POWER_LAW, FREE_FIFO, BENCH_OPERATIONS},
+    {"powerlaw-random", SIZES_POWER_LAW, FREE_RANDOM, BENCH_OPERATIONS},
+    {"churn", SIZES_POWER_LAW, FREE_CHURN, BENCH_OPERATIONS * 5},
+};
+#define BENCH_WORKLOADS (int)(sizeof(benchWorkloads) / sizeof(benchWorkloads[0]))
+
+typedef struct {
+    long operations;
+    double seconds;
+    LatencyHistogram allocLatency;
+    LatencyHistogram freeLatency;
+    float fragmentation;
+    float successRate;
+    long bytesMoved; // By compaction
+    double compactionSeconds;
+    long systemAllocations; // Made by the metadata arena while the workload ran
+} BenchResult;
+
+uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dull;
+}
+
+double randomUnit(uint64_t *state) {
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int sampleSize(SizeDistribution sizes, uint64_t *rng) {
+    switch (sizes) {
+        case SIZES_UNIFORM:
+            return 1 + (int)(nextRandom(rng) % 256);
+        case SIZES_BIMODAL:
+            if (nextRandom(rng) % 10) return 8 + (int)(nextRandom(rng) % 25);
+            return 512 + (int)(nextRandom(rng) % 1537);
+        case SIZES_POWER_LAW: {
+            // Pareto with alpha 1.5 starting at 8 units, capped at 16384.
+            double size = 8.0 / pow(1.0 - randomUnit(rng), 1.0 / 1.5);
+            return size > 16384 ? 16384 : (int)size;
+        }
+        case SIZES_MALLOC: {
+            // Piecewise uniform over the request mix malloc traces usually show:
+            // mostly small objects, with a thin tail of large buffers.
+            static const int limits[] = {16, 32, 64, 128, 256, 512, 1024, 4096, 16384, 65536};
+            static const double cumulative[] = {0.22, 0.45, 0.65, 0.78, 0.87, 0.92, 0.95, 0.985, 0.997, 1.0};
+            double u = randomUnit(rng);
+            int bucket = 0;
+            while (u > cumulative[bucket] && bucket < 9) bucket++;
+            int low = bucket ? limits[bucket - 1] + 1 : 1;
+            return low + (int)(nextRandom(rng) % (limits[bucket] - low + 1));
+        }
+    }
+    return 1;
+}
+
+void recordLatency(LatencyHistogram *h, uint64_t nanos) {
+    int bucket = 0;
+    uint64_t sub = nanos;
+    if (nanos >= HISTOGRAM_SUB_BUCKETS) {
+        bucket = 63 - __builtin_clzll(nanos) - HISTOGRAM_SUB_BITS + 1;
+        sub = (nanos >> (bucket - 1)) - HISTOGRAM_SUB_BUCKETS;
+    }
+    h->counts[bucket][sub]++;
+    h->total++;
+}
+
+// Upper bound of the bucket holding the given percentile, in nanoseconds.
+uint64_t latencyPercentile(const LatencyHistogram *h, double percentile) {
+    long target = (long)(h->total * percentile / 100.0 + 0.5);
+    long seen = 0;
+    if (target < 1) target = 1;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        for (int sub = 0; sub < HISTOGRAM_SUB_BUCKETS; sub++) {
+            seen += h->counts[bucket][sub];
+            if (seen >= target) {
+                if (bucket == 0) return sub;
+                return ((uint64_t)(HISTOGRAM_SUB_BUCKETS + sub + 1) << (bucket - 1)) - 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// live[] holds block handles, or -2 - object for objects served by the slabs.
+void benchFree(MemoryManager *m, SlabAllocator *slabs, int *live, int slot, BenchResult *r) {
+    uint64_t start = nowNanos();
+    if (live[slot] <= -2) {
+        slabFree(slabs, -2 - live[slot]);
+    } else {
+        freeBlock(m, live[slot]);
+    }
+    recordLatency(&r->freeLatency, nowNanos() - start);
+    r->operations++;
+}
+
+// Runs one workload against a fresh arena. Each batch of BENCH_BATCH
+// allocations is followed by half as many frees in the workload's order, so the
+// live set grows until the arena fills; churn instead holds the live set near
+// BENCH_CHURN_LIVE objects with a random alloc/free mix. With slabs, requests
+// that fit a size class go through slab caches on top of the arena.
+void runBenchWorkload(const BenchWorkload *w, int algorithm, long arenaSize, SlabAllocator *slabs,
+                      BenchResult *r) {
+    MemoryManager m = {0};
+    memset(r, 0, sizeof(*r));
+    if (!initializeArena(&m, algorithm, arenaSize)) {
+        destroyArena(&m);
+        return;
+    }
+    if (slabs) initializeSlabs(slabs, &m);
+
+    uint64_t rng = BENCH_SEED;
+    int capacity = (int)w->operations + 1;
+    int *live = malloc(capacity * sizeof(int));
+    int head = 0, tail = 0; // live[head..tail) in allocation order
+    int processID = 0; // Also the number of allocation requests
+    int successes = 0;
+    long systemAllocations = threadSystemAllocations;
+    uint64_t runStart = nowNanos();
+
+    while (r->operations < w->operations) {
+        bool allocateNext = w->order == FREE_CHURN
+                          ? (tail - head < BENCH_CHURN_LIVE && (tail == head || nextRandom(&rng) % 2))
+                          : true;
+        if (allocateNext) {
+            int size = sampleSize(w->sizes, &rng);
+            uint64_t start = nowNanos();
+            int index;
+            ++processID;
+            if (slabs && size <= SLAB_CLASSES * SLAB_GRANULE) {
+                int object = slabAllocate(slabs, size);
+                index = object == -1 ? -1 : -2 - object;
+            } else {
+                index = pointerDispatch
+                      ? allocate(&m, size, fitFunctions[algorithm], algorithmNames[algorithm], processID)
+                      : allocateBlock(&m, size, algorithmNames[algorithm], processID);
+            }
+            recordLatency(&r->allocLatency, nowNanos() - start);
+            r->operations++;
+            if (index != -1) {
+                live[tail++] = index;
+                successes++;
+            }
+        } else {
+            int slot = head + (int)(nextRandom(&rng) % (tail - head));
+            benchFree(&m, slabs, live, slot, r);
+            live[slot] = live[--tail];
+        }
+
+        if (w->order != FREE_CHURN && processID % BENCH_BATCH == 0) {
+            for (int n = BENCH_BATCH / 2; n > 0 && tail > head; n--) {
+                int slot;
+                if (w->order == FREE_LIFO) {
+                    slot = --tail;
+                } else if (w->order == FREE_FIFO) {
+                    slot = head++;
+                } else {
+                    slot = head + (int)(nextRandom(&rng) % (tail - head));
+                }
+                benchFree(&m, slabs, live, slot, r);
+                if (w->order == FREE_RANDOM) {
+                    live[slot] = live[--tail];
+                }
+            }
+        }
+    }
+    r->seconds = (nowNanos() - runStart) / 1e9;
+    r->systemAllocations = threadSystemAllocations - systemAllocations;
+
+    long allocated, freeMemory, fragmentedSize;
+    computeUsage(&m, &allocated, &freeMemory, &fragmentedSize);
+    r->fragmentation = freeMemory > 0 ? (fragmentedSize / (float)freeMemory) * 100 : 0;
+    r->successRate = processID > 0 ? (successes / (float)processID) * 100 : 0;
+    r->bytesMoved = m.bytesMoved;
+    r->compactionSeconds = m.compactionNanos / 1e9;
+    if (slabs) destroySlabs(slabs);
+    free(live);
+    destroyArena(&m);
+}
+
+// Paging has no fit policy; it is measured with a random alloc/free mix over
+// the process table.
+void runPagingBench(BenchResult *r) {
+    memset(r, 0, sizeof(*r));
+    if (!initializePaging()) return;
+    uint64_t rng = BENCH_SEED;
+    long requests = 0, successes = 0;
+    long systemAllocations = threadSystemAllocations;
+    uint64_t runStart = nowNanos();
+    for (long i = 0; i < BENCH_OPERATIONS; i++) {
+        int processID = 1 + (int)(nextRandom(&rng) % (maxProcesses - 1));
+        uint64_t start = nowNanos();
+        if (processes[processID].size == 0) {
+            long size = 1 + (long)(nextRandom(&rng) % (uint64_t)(memorySize / 4));
+            bool ok = allocatePages(processID, size);
+            recordLatency(&r->allocLatency, nowNanos() - start);
+            requests++;
+            successes += ok;
+        } else {
+            deallocatePages(processID);
+            recordLatency(&r->freeLatency, nowNanos() - start);
+        }
+        r->operations++;
+    }
+    r->seconds = (nowNanos() - runStart) / 1e9;
+    r->systemAllocations = threadSystemAllocations - systemAllocations;
+    r->successRate = requests > 0 ? (successes / (float)requests) * 100 : 0;
+    initializePaging();
+}
+
+#define BENCH_CSV_COLUMNS "Technique,Workload,Operations,Seconds,OpsPerSec," \
+                          "AllocP50Ns,AllocP99Ns,AllocP999Ns,FreeP50Ns,FreeP99Ns,FreeP999Ns," \
+                          "Fragmentation,SuccessRate,BytesMoved,CompactionSeconds,SystemAllocations\n"
+
+void printBenchHeader() {
+    printf("%-10s %-16s %11s %7s %7s %7s %7s %7s %7s %7s %7s %10s %8s\n", "Technique", "Workload", "Ops/sec",
+           "A-p50", "A-p99", "A-p999", "F-p50", "F-p99", "F-p999", "Frag", "Success", "Moved", "SysAlloc");
+}
+
+void printBenchResult(FILE *csv, const char *technique, const char *workload, const BenchResult *r) {
+    double opsPerSecond = r->seconds > 0 ? r->operations / r->seconds : 0;
+    printf("%-10s %-16s %11.0f %7llu %7llu %7llu %7llu %7llu %7llu %6.1f%% %6.1f%% %10ld %8ld\n",
+           technique, workload, opsPerSecond,
+           (unsigned long long)latencyPercentile(&r->allocLatency, 50),
+           (unsigned long long)latencyPercentile(&r->allocLatency, 99),
+           (unsigned long long)latencyPercentile(&r->allocLatency, 99.9),
+           (unsigned long long)latencyPercentile(&r->freeLatency, 50),
+           (unsigned long long)latencyPercentile(&r->freeLatency, 99),
+           (unsigned long long)latencyPercentile(&r->freeLatency, 99.9),
+           r->fragmentation, r->successRate, r->bytesMoved, r->systemAllocations);
+    fprintf(csv, "%s,%s,%ld,%.6f,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%.2f,%.2f,%ld,%.6f,%ld\n",
+            technique, workload, r->operations, r->seconds, opsPerSecond,
+            (unsigned long long)latencyPercentile(&r->allocLatency, 50),
+            (unsigned long long)latencyPercentile(&r->allocLatency, 99),
+            (unsigned long long)latencyPercentile(&r->allocLatency, 99.9),
+            (unsigned long long)latencyPercentile(&r->freeLatency, 50),
+            (unsigned long long)latencyPercentile(&r->freeLatency, 99),
+            (unsigned long long)latencyPercentile(&r->freeLatency, 99.9),
+            r->fragmentation, r->successRate, r->bytesMoved, r->compactionSeconds, r->systemAllocations);
+}
+
+bool runBenchmarks(const char *outputPath, long arenaSize) {
+    FILE *csv = fopen(outputPath, "w");
+    if (!csv) {
+        printf("Error opening file %s!\n", outputPath);
+        return false;
+    }
+    fprintf(csv, BENCH_CSV_COLUMNS);
+
+    printf("\nBenchmarks on a %ld unit arena (latencies in ns)\n", arenaSize);
+    printBenchHeader();
+    BenchResult *r = malloc(sizeof(BenchResult));
+    for (int i = 0; i < ALGORITHMS; i++) {
+        for (int w = 0; w < BENCH_WORKLOADS; w++) {
+            runBenchWorkload(&benchWorkloads[w], i, arenaSize, NULL, r);
+            printBenchResult(csv, algorithmNames[i], benchWorkloads[w].name, r);
+        }
+    }
+
+    // Slab caches over first and best fit, against the raw rows above.
+    const char *slabNames[] = {"Slab First", "Slab Best"};
+    SlabAllocator *slabs = malloc(sizeof(SlabAllocator));
+    SlabAllocator *churnSlabs = malloc(sizeof(SlabAllocator));
+    for (int i = 0; i < 2; i++) {
+        for (int w = 0; w < BENCH_WORKLOADS; w++) {
+            bool churn = i == 0 && benchWorkloads[w].order == FREE_CHURN;
+            runBenchWorkload(&benchWorkloads[w], i, arenaSize, churn ? churnSlabs : slabs, r);
+            printBenchResult(csv, slabNames[i], benchWorkloads[w].name, r);
+        }
+    }
+    runPagingBench(r);
+    printBenchResult(csv, "Paging", "churn", r);
+    printf("\nSlab caches after churn on %s (objects up to %d units, %ld unit slabs):\n",
+           algorithmNames[0], SLAB_CLASSES * SLAB_GRANULE, churnSlabs->slabSize);
+    showSlabStats(churnSlabs);
+    free(churnSlabs);
+    free(slabs);
+    free(r);
+    fclose(csv);
+    printf("\nBenchmark results saved to %s\n", outputPath);
+    return true;
+}
+
+// Runs every workload through allocate() with the fit passed as a pointer and
+// through the specialized allocators, alternating the two and keeping the
+// fastest of DISPATCH_REPEATS runs each to damp scheduling noise.
+bool runDispatchBenchmark(const char *outputPath, long arenaSize) {
+    FILE *csv = fopen(outputPath, "w");
+    if (!csv) {
+        printf("Error opening file %s!\n", outputPath);
+        return false;
+    }
+    fprintf(csv, "Technique,Workload,Operations,PointerSeconds,SpecializedSeconds,Speedup\n");
+
+    printf("\nFit dispatch on a %ld unit arena (best of %d runs)\n", arenaSize, DISPATCH_REPEATS);
+    printf("%-10s %-16s %13s %13s %8s\n", "Technique", "Workload", "Pointer op/s", "Special op/s", "Speedup");
+    BenchResult *r = malloc(sizeof(BenchResult));
+    for (int i = 0; i < ALGORITHMS; i++) {
+        double pointerTotal = 0, specializedTotal = 0;
+        for (int w = 0; w < BENCH_WORKLOADS; w++) {
+            double best[2] = {0, 0};
+            long operations = 0;
+            for (int run = 0; run < DISPATCH_REPEATS * 2; run++) {
+                pointerDispatch = run % 2 == 0;
+                runBenchWorkload(&benchWorkloads[w], i, arenaSize, NULL, r);
+                if (best[run % 2] == 0 || r->seconds < best[run % 2]) best[run % 2] = r->seconds;
+                operations = r->operations;
+            }
+            pointerDispatch = false;
+            pointerTotal += best[0];
+            specializedTotal += best[1];
+            printf("%-10s %-16s %13.0f %13.0f %7.2fx\n", algorithmNames[i], benchWorkloads[w].name,
+                   operations / best[0], operations / best[1], best[0] / best[1]);
+            fprintf(csv, "%s,%s,%ld,%.6f,%.6f,%.3f\n", algorithmNames[i], benchWorkloads[w].name,
+                    operations, best[0], best[1], best[0] / best[1]);
+        }
+        printf("%-10s %-16s %13s %13s %7.2fx\n", algorithmNames[i], "all", "", "",
+               pointerTotal / specializedTotal);
+    }
+    free(r);
+    fclose(csv);
+    printf("\nDispatch results saved to %s\n", outputPath);
+    return true;
+}
+
+// Parameter sweep: every fit policy x bench workload x arena size is an
+// independent simulation on its own MemoryManager, so the configurations are
+// fanned out over a thread pool. Jobs are dealt round-robin onto per-thread
+// deques; a thread pops the back of its own deque and, once that runs dry,
+// steals from the front of the others. Each result lands in its job's slot and
+// the table is printed in configuration order after the threads join.
+#define MAX_SWEEP_ARENAS 16
+
+typedef struct {
+    int algorithm;
+    int workload;
+    long arenaSize;
+} SweepJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *jobs;
+    int top, bottom; // jobs[top..bottom) are still queued
+} SweepDeque;
+
+typedef struct {
+    const SweepJob *jobs;
+    BenchResult *results;
+    SweepDeque *deques;
+    int threads;
+    int id;
+    pthread_t thread;
+    long completed;
+    long stolen;
+    double cpuSeconds;
+} SweepWorker;
+
+int sweepPop(SweepDeque *d) {
+    pthread_mutex_lock(&d->lock);
+    int job = d->bottom > d->top ? d->jobs[--d->bottom] : -1;
+    pthread_mutex_unlock(&d->lock);
+    return job;
+}
+
+int sweepSteal(SweepDeque *d) {
+    pthread_mutex_lock(&d->lock);
+    int job = d->bottom > d->top ? d->jobs[d->top++] : -1;
+    pthread_mutex_unlock(&d->lock);
+    return job;
+}
+
+// No jobs are added once the pool starts, so a thread that finds every deque
+// empty is done.
+void *sweepWorkerMain(void *arg) {
+    SweepWorker *w = arg;
+    while (1) {
+        int job = sweepPop(&w->deques[w->id]);
+        for (int k = 1; job == -1 && k < w->threads; k++) {
+            job = sweepSteal(&w->deques[(w->id + k) % w->threads]);
+            if (job != -1) w->stolen++;
+        }
+        if (job == -1) break;
+        const SweepJob *j = &w->jobs[job];
+        runBenchWorkload(&benchWorkloads[j->workload], j->algorithm, j->arenaSize, NULL, &w->results[job]);
+        w->completed++;
+    }
+    struct timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    w->cpuSeconds = cpu.tv_sec + cpu.tv_nsec / 1e9;
+    return NULL;
+}
+
+void freeSweep(SweepJob *jobs, BenchResult *results, SweepDeque *deques, SweepWorker *workers, int threads) {
+    for (int t = 0; deques && t < threads; t++) {
+        free(deques[t].jobs);
+    }
+    free(deques);
+    free(workers);
+    free(results);
+    free(jobs);
+}
+
+bool runSweep(const char *outputPath, const long *arenaSizes, int arenaCount, int threads) {
+    int jobCount = arenaCount * BENCH_WORKLOADS * ALGORITHMS;
+    if (threads > jobCount) threads = jobCount;
+    SweepJob *jobs = malloc(jobCount * sizeof(SweepJob));
+    BenchResult *results = malloc(jobCount * sizeof(BenchResult));
+    SweepDeque *deques = calloc(threads, sizeof(SweepDeque));
+    SweepWorker *workers = calloc(threads, sizeof(SweepWorker));
+    bool ok = jobs && results && deques && workers;
+    for (int t = 0; ok && t < threads; t++) {
+        deques[t].jobs = malloc((jobCount / threads + 1) * sizeof(int));
+        if (!deques[t].jobs) ok = false;
+    }
+    if (!ok) {
+        printf("Out of memory for %d sweep jobs on %d threads!\n", jobCount, threads);
+        freeSweep(jobs, results, deques, workers, threads);
+        return false;
+    }
+    FILE *csv = fopen(outputPath, "w");
+    if (!csv) {
+        printf("Error opening file %s!\n", outputPath);
+        freeSweep(jobs, results, deques, workers, threads);
+        return false;
+    }
+
+    int n = 0;
+    for (int a = 0; a < arenaCount; a++) {
+        for (int w = 0; w < BENCH_WORKLOADS; w++) {
+            for (int i = 0; i < ALGORITHMS; i++) {
+                jobs[n++] = (SweepJob){i, w, arenaSizes[a]};
+            }
+        }
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_init(&deques[t].lock, NULL);
+    }
+    for (int job = 0; job < jobCount; job++) {
+        SweepDeque *d = &deques[job % threads];
+        d->jobs[d->bottom++] = job;
+    }
+
+    printf("\nSweeping %d configurations (%d arena sizes x %d workloads x %d policies) on %d threads\n",
+           jobCount, arenaCount, BENCH_WORKLOADS, ALGORITHMS, threads);
+    uint64_t start = nowNanos();
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (SweepWorker){.jobs = jobs, .results = results, .deques = deques, .threads = threads, .id = t};
+        pthread_create(&workers[t].thread, NULL, sweepWorkerMain, &workers[t]);
+    }
+    long stolen = 0;
+    double cpuSeconds = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(workers[t].thread, NULL);
+        stolen += workers[t].stolen;
+        cpuSeconds += workers[t].cpuSeconds;
+    }
+    double wallSeconds = (nowNanos() - start) / 1e9;
+
+    fprintf(csv, "ArenaSize," BENCH_CSV_COLUMNS);
+    printf("%-9s ", "Arena");
+    printBenchHeader();
+    for (int job = 0; job < jobCount; job++) {
+        fprintf(csv, "%ld,", jobs[job].arenaSize);
+        printf("%-9ld ", jobs[job].arenaSize);
+        printBenchResult(csv, algorithmNames[jobs[job].algorithm], benchWorkloads[jobs[job].workload].name,
+                         &results[job]);
+    }
+    printf("\nSweep took %.2f s wall, %.2f s CPU across threads (%.1fx parallel), %ld jobs stolen\n",
+           wallSeconds, cpuSeconds, wallSeconds > 0 ? cpuSeconds / wallSeconds : 0, stolen);
+
+    for (int t = 0; t < threads; t++) {
+        pthread_mutex_destroy(&deques[t].lock);
+    }
+    freeSweep(jobs, results, deques, workers, threads);
+    fclose(csv);
+    printf("Sweep results saved to %s\n", outputPath);
+    return true;
+}
+
+// Workload generator: synthesizes a trace from parameterized distributions
+// instead of reading one. Object sizes follow a SizeDistribution and
+// lifetimes, counted in allocations, are exponential or Pareto; each phase
+// rescales both. Processes arrive at a fixed rate, map pages while they run
+// and free their remaining objects when they exit. Every live object has its
+// own id (recycled once freed), so an F event frees exactly that object.
+// Events go straight into the simulator or into a binary trace file.
+#define GEN_PARETO_ALPHA 1.2
+#define GEN_TARGET_LOAD 0.7 // Live units the default mean lifetime aims for, as a fraction of memorySize
+#define GEN_PAGING_LOAD 0.5 // Same for the pages of all running processes
+#define GEN_SIZE_SAMPLES 65536
+#define GEN_MAX_LIFETIME 1e15
+
+typedef enum { LIFETIME_EXPONENTIAL, LIFETIME_PARETO } LifetimeDistribution;
+const char *lifetimeNames[] = {"exp", "pareto"};
+#define LIFETIME_DISTRIBUTIONS 2
+
 typedef struct {
-    Block memory[MAX_BLOCKS];
-    int totalBlocks;
-    int lastAlloc;
-    int successfulAllocations;
-    int failedAllocations;
-    int totalRequests;
-} MemoryManager;
+    long events; // 0 when the generator is off
+    uint64_t seed;
+    SizeDistribution sizes;
+    LifetimeDistribution lifetimes;
+    double meanLifetime; // In allocations; 0 derives it from GEN_TARGET_LOAD
+    long phaseLength; // Events per phase, 0 for a single phase
+    double processRate; // Process arrivals per allocation
+    double processLifetime; // Mean, in allocations
+} GeneratorConfig;
 
 typedef struct {
-    int pageTable[20]; // Assuming max 20 pages per process
-    int size;
-    int processID;
-} Process;
+    uint64_t time;
+    int id; // Object id, or -slot for a process exit
+} GenDeadline;
 
-MemoryManager managers[ALGORITHMS];
-const char* algorithmNames[ALGORITHMS] = {"First Fit", "Best Fit", "Worst Fit", "Next Fit"};
-Process processes[MAX_PROCESSES];
-int nextProcessID = 1;
-int pageFrames[MEMORY_SIZE/PAGE_SIZE]; // Tracks which frames are allocated
+typedef struct {
+    int owner; // Process slot, 0 for none
+    int prev; // Siblings on the owner's object list
+    int next;
+    long heapSlot; // Position of the object's deadline
+} GenObject;
 
-void initializeMemory(MemoryManager *m) {
-    m->totalBlocks = 1;
-    m->lastAlloc = 0;
-    m->successfulAllocations = 0;
-    m->failedAllocations = 0;
-    m->totalRequests = 0;
-    m->memory[0].start = 0;
-    m->memory[0].size = MEMORY_SIZE;
-    m->memory[0].allocated = false;
-    m->memory[0].processID = -1;
-}
+typedef struct {
+    const GeneratorConfig *config;
+    uint64_t rng;
+    FILE *out; // NULL to apply events directly
+    long events, rejected;
+    long allocations, frees, arrivals, exits;
+    GenDeadline *heap; // Min-heap of object deaths and process exits
+    long heapSize, heapCapacity;
+    GenObject *objects;
+    int objectCount, objectCapacity;
+    int *freeIds;
+    int freeIdCount;
+    int *processObjects; // Per slot, first object on its list or -1
+    int *liveProcesses; // Running slots, for picking owners
+    int *livePosition; // Index of each running slot in liveProcesses
+    int liveCount;
+    int *freeSlots;
+    int freeSlotCount;
+    double meanLifetime;
+    double sizeScale, lifetimeScale;
+    double footprint; // Mean paging request of a process
+} Generator;
 
-void initializePaging() {
-    for (int i = 0; i < MEMORY_SIZE/PAGE_SIZE; i++) {
-        pageFrames[i] = -1; // -1 means frame is free
+void emitEvent(Generator *g, uint8_t op, int processID, long arg) {
+    if (g->events >= g->config->events) return;
+    TraceEvent e = {op, SEG_HEAP, (uint32_t)processID, (uint64_t)arg, 0};
+    if (g->out) {
+        writeTraceEvent(g->out, &e);
+    } else {
+        if (!applyTraceEvent(&e)) g->rejected++;
+        metricsTick();
     }
+    g->events++;
 }
 
-void displayMemory(MemoryManager *m, const char* algoName) {
-    printf("\n=== %s Memory Layout ===\n", algoName);
-    printf("Start End  Size    Status      Process\n");
-    printf("----- ---  ----    ------      -------\n");
-    for (int i = 0; i < m->totalBlocks; i++) {
-        printf("%4d %4d %4d    %-10s %d\n",
-               m->memory[i].start,
-               m->memory[i].start + m->memory[i].size - 1,
-               m->memory[i].size,
-               m->memory[i].allocated ? "Allocated" : "Free",
-               m->memory[i].processID);
-    }
+void deadlineSet(Generator *g, long i, GenDeadline d) {
+    g->heap[i] = d;
+    if (d.id > 0) g->objects[d.id].heapSlot = i;
 }
 
-int firstFit(MemoryManager *m, int size) {
-    for (int i = 0; i < m->totalBlocks; i++) {
-        if (!m->memory[i].allocated && m->memory[i].size >= size) {
-            return i;
-        }
+void deadlineSiftUp(Generator *g, long i) {
+    GenDeadline d = g->heap[i];
+    while (i > 0 && g->heap[(i - 1) / 2].time > d.time) {
+        deadlineSet(g, i, g->heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
     }
-    return -1;
+    deadlineSet(g, i, d);
 }
 
-int bestFit(MemoryManager *m, int size) {
-    int bestIndex = -1;
-    int minSize = MEMORY_SIZE + 1;
-    for (int i = 0; i < m->totalBlocks; i++) {
-        if (!m->memory[i].allocated && m->memory[i].size >= size && m->memory[i].size < minSize) {
-            bestIndex = i;
-            minSize = m->memory[i].size;
-        }
+void deadlineSiftDown(Generator *g, long i) {
+    GenDeadline d = g->heap[i];
+    while (2 * i + 1 < g->heapSize) {
+        long child = 2 * i + 1;
+        if (child + 1 < g->heapSize && g->heap[child + 1].time < g->heap[child].time) child++;
+        if (g->heap[child].time >= d.time) break;
+        deadlineSet(g, i, g->heap[child]);
+        i = child;
     }
-    return bestIndex;
+    deadlineSet(g, i, d);
 }
 
-int worstFit(MemoryManager *m, int size) {
-    int worstIndex = -1;
-    int maxSize = -1;
-    for (int i = 0; i < m->totalBlocks; i++) {
-        if (!m->memory[i].allocated && m->memory[i].size >= size && m->memory[i].size > maxSize) {
-            worstIndex = i;
-            maxSize = m->memory[i].size;
-        }
+// Returns false, leaving the heap unchanged, if it cannot grow.
+bool deadlinePush(Generator *g, uint64_t time, int id) {
+    if (g->heapSize == g->heapCapacity) {
+        long capacity = g->heapCapacity ? g->heapCapacity * 2 : 1024;
+        GenDeadline *heap = resizeArray(g->heap, g->heapCapacity * sizeof(GenDeadline),
+                                        capacity * sizeof(GenDeadline));
+        if (!heap) return false;
+        g->heap = heap;
+        g->heapCapacity = capacity;
     }
-    return worstIndex;
+    g->heap[g->heapSize] = (GenDeadline){time, id};
+    deadlineSiftUp(g, g->heapSize++);
+    return true;
 }
 
-int nextFit(MemoryManager *m, int size) {
-    for (int i = m->lastAlloc; i < m->totalBlocks; i++) {
-        if (!m->memory[i].allocated && m->memory[i].size >= size) {
-            m->lastAlloc = i;
-            return i;
-        }
-    }
-    for (int i = 0; i < m->lastAlloc; i++) {
-        if (!m->memory[i].allocated && m->memory[i].size >= size) {
-            m->lastAlloc = i;
-            return i;
-        }
+void deadlineRemove(Generator *g, long i) {
+    GenDeadline last = g->heap[--g->heapSize];
+    if (i == g->heapSize) return;
+    g->heap[i] = last;
+    if (i > 0 && g->heap[(i - 1) / 2].time > last.time) {
+        deadlineSiftUp(g, i);
+    } else {
+        deadlineSiftDown(g, i);
     }
-    return -1;
 }
 
-void allocate(MemoryManager *m, int size, int (*fitFunction)(MemoryManager*, int), const char* algoName, int processID) {
-    m->totalRequests++;
-    int index = fitFunction(m, size);
-    
-    if (index == -1) {
-        printf("  [%s] Failed to allocate %d bytes for process %d\n", algoName, size, processID);
-        m->failedAllocations++;
-        return;
-    }
-
-    if (m->memory[index].size > size) {
-        if (m->totalBlocks >= MAX_BLOCKS) {
-            printf("  [%s] Cannot split - max blocks reached\n", algoName);
-            m->failedAllocations++;
-            return;
-        }
-
-        for (int i = m->totalBlocks; i > index + 1; i--) {
-            m->memory[i] = m->memory[i - 1];
-        }
+GenDeadline deadlinePop(Generator *g) {
+    GenDeadline top = g->heap[0];
+    deadlineRemove(g, 0);
+    return top;
+}
 
-        m->memory[index + 1].start = m->memory[index].start + size;
-        m->memory[index + 1].size = m->memory[index].size - size;
-        m->memory[index + 1].allocated = false;
-        m->memory[index + 1].processID = -1;
-        m->totalBlocks++;
+double sampleLifetime(Generator *g, double mean) {
+    double u = randomUnit(&g->rng);
+    double life;
+    if (g->config->lifetimes == LIFETIME_PARETO) {
+        double scale = mean * (GEN_PARETO_ALPHA - 1) / GEN_PARETO_ALPHA;
+        life = scale / pow(1.0 - u, 1.0 / GEN_PARETO_ALPHA);
+    } else {
+        life = -mean * log(1.0 - u);
     }
+    return life < GEN_MAX_LIFETIME ? life : GEN_MAX_LIFETIME;
+}
 
-    m->memory[index].size = size;
-    m->memory[index].allocated = true;
-    m->memory[index].processID = processID;
-    m->successfulAllocations++;
-    
-    printf("  [%s] Allocated %d bytes at %d-%d for process %d\n", 
-           algoName, size, 
-           m->memory[index].start,
-           m->memory[index].start + size - 1,
-           processID);
+long sampleObjectSize(Generator *g) {
+    long size = (long)(sampleSize(g->config->sizes, &g->rng) * g->sizeScale);
+    if (size < 1) return 1;
+    return size < memorySize ? size : memorySize;
 }
 
-void deallocate(MemoryManager *m, int processID, const char* algoName) {
-    bool found = false;
-    for (int i = 0; i < m->totalBlocks; i++) {
-        if (m->memory[i].allocated && m->memory[i].processID == processID) {
-            m->memory[i].allocated = false;
-            m->memory[i].processID = -1;
-            printf("  [%s] Freed block at %d-%d (%d bytes) for process %d\n",
-                   algoName,
-                   m->memory[i].start,
-                   m->memory[i].start + m->memory[i].size - 1,
-                   m->memory[i].size,
-                   processID);
-            found = true;
-            
-            if (i > 0 && !m->memory[i-1].allocated) {
-                m->memory[i-1].size += m->memory[i].size;
-                for (int j = i; j < m->totalBlocks - 1; j++) {
-                    m->memory[j] = m->memory[j + 1];
-                }
-                m->totalBlocks--;
-                i--;
-            }
-            if (i < m->totalBlocks - 1 && !m->memory[i+1].allocated) {
-                m->memory[i].size += m->memory[i+1].size;
-                for (int j = i + 1; j < m->totalBlocks - 1; j++) {
-                    m->memory[j] = m->memory[j + 1];
-                }
-                m->totalBlocks--;
-            }
-        }
-    }
-    if (!found) {
-        printf("  [%s] No allocated blocks found for process %d\n", algoName, processID);
-    }
+// Each phase scales object sizes and lifetimes by independent factors in [1/4, 4].
+void startPhase(Generator *g) {
+    g->sizeScale = pow(2.0, 4.0 * randomUnit(&g->rng) - 2.0);
+    g->lifetimeScale = pow(2.0, 4.0 * randomUnit(&g->rng) - 2.0);
 }
 
-void allocatePages(int processID, int size) {
-    int pagesNeeded = (size + PAGE_SIZE - 1) / PAGE_SIZE;
-    int allocatedPages = 0;
-    
-    printf("\nAttempting to allocate %d pages for process %d\n", pagesNeeded, processID);
-    
-    for (int i = 0; i < MEMORY_SIZE/PAGE_SIZE && allocatedPages < pagesNeeded; i++) {
-        if (pageFrames[i] == -1) {
-            pageFrames[i] = processID;
-            processes[processID].pageTable[allocatedPages] = i;
-            allocatedPages++;
-            printf("  Allocated page %d (frame %d) to process %d\n", 
-                   allocatedPages-1, i, processID);
+// Returns false if the generator's tables cannot grow; generation then stops.
+bool allocateObject(Generator *g, uint64_t tick) {
+    int id;
+    if (g->freeIdCount) {
+        id = g->freeIds[--g->freeIdCount];
+    } else {
+        if (g->objectCount >= g->objectCapacity) {
+            int capacity = g->objectCapacity ? g->objectCapacity * 2 : 1024;
+            GenObject *objects = resizeArray(g->objects, g->objectCapacity * sizeof(GenObject),
+                                             capacity * sizeof(GenObject));
+            if (!objects) return false;
+            g->objects = objects;
+            int *freeIds = resizeArray(g->freeIds, g->objectCapacity * sizeof(int), capacity * sizeof(int));
+            if (!freeIds) return false;
+            g->freeIds = freeIds;
+            g->objectCapacity = capacity;
         }
+        id = g->objectCount++;
     }
-    
-    if (allocatedPages < pagesNeeded) {
-        printf("  Could only allocate %d of %d needed pages\n", allocatedPages, pagesNeeded);
-        // Free any allocated pages if we couldn't satisfy the request
-        for (int i = 0; i < allocatedPages; i++) {
-            pageFrames[processes[processID].pageTable[i]] = -1;
-        }
-    } else {
-        processes[processID].size = size;
-        processes[processID].processID = processID;
-        printf("  Successfully allocated %d pages for process %d\n", pagesNeeded, processID);
+    GenObject *o = &g->objects[id];
+    o->owner = g->liveCount ? g->liveProcesses[nextRandom(&g->rng) % g->liveCount] : 0;
+    o->prev = -1;
+    o->next = -1;
+    if (o->owner) {
+        o->next = g->processObjects[o->owner];
+        if (o->next != -1) g->objects[o->next].prev = id;
+        g->processObjects[o->owner] = id;
     }
+    long size = sampleObjectSize(g);
+    uint64_t death = tick + 1 + (uint64_t)sampleLifetime(g, g->meanLifetime * g->lifetimeScale);
+    if (!deadlinePush(g, death, id)) return false;
+    emitEvent(g, 'A', id, size);
+    g->allocations++;
+    return true;
 }
 
-void deallocatePages(int processID) {
-    printf("\nDeallocating pages for process %d\n", processID);
-    for (int i = 0; i < MEMORY_SIZE/PAGE_SIZE; i++) {
-        if (pageFrames[i] == processID) {
-            pageFrames[i] = -1;
-            printf("  Freed frame %d from process %d\n", i, processID);
-        }
+void freeObject(Generator *g, int id) {
+    GenObject *o = &g->objects[id];
+    if (o->prev != -1) {
+        g->objects[o->prev].next = o->next;
+    } else if (o->owner) {
+        g->processObjects[o->owner] = o->next;
     }
-    processes[processID].size = 0;
+    if (o->next != -1) g->objects[o->next].prev = o->prev;
+    g->freeIds[g->freeIdCount++] = id;
+    emitEvent(g, 'F', id, 0);
+    g->frees++;
 }
 
-void displayPageTable(int processID) {
-    if (processes[processID].size == 0) {
-        printf("No pages allocated for process %d\n", processID);
-        return;
-    }
-    
-    printf("\nPage Table for Process %d:\n", processID);
-    printf("Page  Frame\n");
-    printf("----  -----\n");
-    
-    int pages = (processes[processID].size + PAGE_SIZE - 1) / PAGE_SIZE;
-    for (int i = 0; i < pages; i++) {
-        printf("%4d  %5d\n", i, processes[processID].pageTable[i]);
-    }
+// Returns false if the deadline heap cannot grow; generation then stops.
+bool startProcess(Generator *g, uint64_t tick) {
+    if (g->freeSlotCount == 0) return true; // Process table full; the arrival is dropped
+    int slot = g->freeSlots[--g->freeSlotCount];
+    g->processObjects[slot] = -1;
+    g->livePosition[slot] = g->liveCount;
+    g->liveProcesses[g->liveCount++] = slot;
+    long size = (long)(-g->footprint * log(1.0 - randomUnit(&g->rng)));
+    uint64_t exit = tick + 1 + (uint64_t)sampleLifetime(g, g->config->processLifetime);
+    if (!deadlinePush(g, exit, -slot)) return false;
+    emitEvent(g, 'P', slot, size < 1 ? 1 : size < memorySize ? size : memorySize);
+    g->arrivals++;
+    return true;
 }
 
-void displayPagingMemory() {
-    printf("\nPaging Memory Status (Frame Allocation):\n");
-    printf("Frame  Process\n");
-    printf("-----  -------\n");
-    for (int i = 0; i < MEMORY_SIZE/PAGE_SIZE; i++) {
-        printf("%5d  %7d\n", i, pageFrames[i]);
+void exitProcess(Generator *g, int slot) {
+    while (g->processObjects[slot] != -1) {
+        int id = g->processObjects[slot];
+        deadlineRemove(g, g->objects[id].heapSlot);
+        freeObject(g, id);
     }
+    emitEvent(g, 'U', slot, 0);
+    int last = g->liveProcesses[--g->liveCount];
+    g->liveProcesses[g->livePosition[slot]] = last;
+    g->livePosition[last] = g->livePosition[slot];
+    g->freeSlots[g->freeSlotCount++] = slot;
+    g->exits++;
 }
 
-void allocateSegment(int processID, int size) {
-    printf("\nAllocating segment for process %d using First Fit\n", processID);
-    allocate(&managers[0], size, firstFit, "Segmentation", processID);
+// The default mean lifetime keeps about GEN_TARGET_LOAD of memory live
+// (Little's law), using the mean of the size distribution as sampled here.
+double defaultLifetime(const GeneratorConfig *config) {
+    Generator probe = {.config = config, .rng = config->seed ^ 0x9e3779b97f4a7c15ull, .sizeScale = 1};
+    double total = 0;
+    for (int i = 0; i < GEN_SIZE_SAMPLES; i++) {
+        total += sampleObjectSize(&probe);
+    }
+    double life = GEN_TARGET_LOAD * memorySize / (total / GEN_SIZE_SAMPLES);
+    return life > 1 ? life : 1;
 }
 
-void deallocateSegment(int processID) {
-    printf("\nDeallocating segments for process %d\n", processID);
-    deallocate(&managers[0], processID, "Segmentation");
+void freeGenerator(Generator *g) {
+    freeArray(g->heap);
+    freeArray(g->objects);
+    freeArray(g->freeIds);
+    freeArray(g->processObjects);
+    freeArray(g->liveProcesses);
+    freeArray(g->livePosition);
+    freeArray(g->freeSlots);
+    free(g);
 }
 
-void displaySegments(int processID) {
-    printf("\nSegments for Process %d:\n", processID);
-    printf("Start  Size\n");
-    printf("-----  ----\n");
-    for (int i = 0; i < managers[0].totalBlocks; i++) {
-        if (managers[0].memory[i].allocated && managers[0].memory[i].processID == processID) {
-            printf("%5d  %4d\n", managers[0].memory[i].start, managers[0].memory[i].size);
+// Streams config->events events into outputPath as a binary trace, or into
+// the simulator when outputPath is NULL.
+bool generateTrace(const GeneratorConfig *config, const char *outputPath) {
+    Generator *g = calloc(1, sizeof(Generator));
+    if (g) {
+        g->processObjects = allocArray(maxProcesses * sizeof(int));
+        g->liveProcesses = allocArray(maxProcesses * sizeof(int));
+        g->livePosition = allocArray(maxProcesses * sizeof(int));
+        g->freeSlots = allocArray(maxProcesses * sizeof(int));
+    }
+    if (!g || !g->processObjects || !g->liveProcesses || !g->livePosition || !g->freeSlots) {
+        printf("Out of memory for a generator with %d processes!\n", maxProcesses);
+        if (g) freeGenerator(g);
+        return false;
+    }
+    g->config = config;
+    g->rng = config->seed ? config->seed : 1;
+    if (outputPath) {
+        g->out = fopen(outputPath, "wb");
+        if (!g->out) {
+            printf("Error opening file %s!\n", outputPath);
+            freeGenerator(g);
+            return false;
         }
+        setvbuf(g->out, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+        fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, g->out);
     }
-}
-
-void saveStatistics() {
-    FILE *file = fopen("memory_stats.txt", "w");
-    if (!file) {
-        printf("Error opening file!\n");
-        return;
+    for (int slot = maxProcesses - 1; slot >= 1; slot--) {
+        g->freeSlots[g->freeSlotCount++] = slot;
     }
+    g->objectCount = 1; // Id 0 is never handed out
+    g->meanLifetime = config->meanLifetime > 0 ? config->meanLifetime : defaultLifetime(config);
+    g->sizeScale = g->lifetimeScale = 1;
+    double running = config->processRate * config->processLifetime;
+    if (running > maxProcesses - 1) running = maxProcesses - 1;
+    g->footprint = GEN_PAGING_LOAD * memorySize / (running > 1 ? running : 1);
 
-    fprintf(file, "Memory Management Technique,Allocated,Free,Fragmentation,SuccessRate,ExtraInfo\n");
-
-    for (int i = 0; i < ALGORITHMS; i++) {
-        int allocated = 0, freeMemory = 0, fragmentedSize = 0, totalFreeBlocks = 0;
-
-        for (int j = 0; j < managers[i].totalBlocks; j++) {
-            if (managers[i].memory[j].allocated) {
-                allocated += managers[i].memory[j].size;
+    long systemAllocations = meta.systemAllocations;
+    uint64_t start = nowNanos();
+    uint64_t tick = 0; // Allocations so far; lifetimes are measured in these
+    bool outOfMemory = false;
+    long nextPhase = config->phaseLength;
+    while (g->events < config->events) {
+        if (config->phaseLength && g->events >= nextPhase) {
+            startPhase(g);
+            nextPhase += config->phaseLength;
+        }
+        if (g->heapSize && g->heap[0].time <= tick) {
+            GenDeadline d = deadlinePop(g);
+            if (d.id < 0) {
+                exitProcess(g, -d.id);
             } else {
-                freeMemory += managers[i].memory[j].size;
-                totalFreeBlocks++;
-                if (managers[i].memory[j].size <= FRAG_THRESHOLD) {
-                    fragmentedSize += managers[i].memory[j].size;
-                }
+                freeObject(g, d.id);
             }
+            continue;
         }
-
-        float fragmentationPercent = (freeMemory > 0) ? 
-                                   (fragmentedSize / (float)freeMemory) * 100 : 0;
-        float successRate = managers[i].totalRequests > 0 
-                          ? (managers[i].successfulAllocations / (float)managers[i].totalRequests) * 100 
-                          : 0;
-
-        fprintf(file, "%s,%d,%d,%.2f,%.2f,%s\n", 
-                algorithmNames[i], allocated, freeMemory, fragmentationPercent, successRate,
-                "Dynamic Partitioning");
+        if (config->processRate > 0 && randomUnit(&g->rng) < config->processRate && !startProcess(g, tick)) {
+            outOfMemory = true;
+            break;
+        }
+        if (!allocateObject(g, tick)) {
+            outOfMemory = true;
+            break;
+        }
+        tick++;
     }
+    double seconds = (nowNanos() - start) / 1e9;
 
-    int allocatedFrames = 0;
-    int totalFrames = MEMORY_SIZE/PAGE_SIZE;
-    for (int i = 0; i < totalFrames; i++) {
-        if (pageFrames[i] != -1) {
-            allocatedFrames++;
-        }
+    printf("\nGenerated %ld events (%ld allocations, %ld frees, %ld process arrivals, %ld exits) "
+           "from seed %llu in %.3f s (%.0f events/s)\n",
+           g->events, g->allocations, g->frees, g->arrivals, g->exits, (unsigned long long)config->seed,
+           seconds, seconds > 0 ? g->events / seconds : 0.0);
+    printf("Sizes: %s, lifetimes: %s with mean %.1f allocations, %d processes still running\n",
+           sizeDistributionNames[config->sizes], lifetimeNames[config->lifetimes], g->meanLifetime, g->liveCount);
+    if (outOfMemory) printf("Out of memory for the generator's tables, stopped after %ld events\n", g->events);
+    if (g->out) {
+        fclose(g->out);
+        printf("Wrote %ld events to %s\n", g->events, outputPath);
+    } else {
+        printf("%ld events rejected\n", g->rejected);
+        showMetaArenaStats(systemAllocations);
     }
-    float pagingUtilization = (allocatedFrames / (float)totalFrames) * 100;
-    fprintf(file, "Paging,%d,%d,%.2f,%.2f,%s\n",
-            allocatedFrames*PAGE_SIZE,
-            (totalFrames-allocatedFrames)*PAGE_SIZE,
-            0.0,
-            100.0,
-            "Frame Utilization");
+    freeGenerator(g);
+    return !outOfMemory;
+}
 
-    int segmentAllocated = 0, segmentFree = 0, segmentFragments = 0;
-    for (int j = 0; j < managers[0].totalBlocks; j++) {
-        if (managers[0].memory[j].allocated) {
-            segmentAllocated += managers[0].memory[j].size;
-        } else {
-            segmentFree += managers[0].memory[j].size;
-            if (managers[0].memory[j].size <= FRAG_THRESHOLD) {
-                segmentFragments++;
-            }
-        }
+// Parses a size with an optional binary suffix (K, M, G or T); -1 if invalid.
+long parseSize(const char *text) {
+    char *end;
+    long size = strtol(text, &end, 10);
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        case 't': case 'T': shift = 40; end++; break;
     }
-    float segmentFragmentation = (segmentFree > 0) ? 
-                           (segmentFragments * FRAG_THRESHOLD / (float)segmentFree) * 100 : 0;
-    float segmentSuccessRate = managers[0].totalRequests > 0 
-                         ? (managers[0].successfulAllocations / (float)managers[0].totalRequests) * 100 
-                         : 0;
-    fprintf(file, "Segmentation,%d,%d,%.2f,%.2f,%s\n",
-            segmentAllocated, segmentFree, segmentFragmentation, segmentSuccessRate,
-            "External Fragmentation");
+    if (end == text || *end != '\0' || size <= 0 || size > LONG_MAX >> shift) return -1;
+    return size << shift;
+}
 
-    fclose(file);
-    printf("\nStatistics saved to memory_stats.txt\n");
+// parseSize() for settings that may also be 0.
+long parseSizeOrZero(const char *text) {
+    return strcmp(text, "0") == 0 ? 0 : parseSize(text);
 }
 
-void showCurrentStats() {
-    printf("\nCurrent Statistics:\n");
-    printf("Technique           Allocated  Free     Fragmentation  Success\n");
-    printf("------------------  ---------  -------  ------------  -------\n");
-    
-    for (int i = 0; i < ALGORITHMS; i++) {
-        int allocated = 0, freeMemory = 0, fragmentedSize = 0;
-        
-        for (int j = 0; j < managers[i].totalBlocks; j++) {
-            if (managers[i].memory[j].allocated) {
-                allocated += managers[i].memory[j].size;
-            } else {
-                freeMemory += managers[i].memory[j].size;
-                if (managers[i].memory[j].size <= FRAG_THRESHOLD) {
-                    fragmentedSize += managers[i].memory[j].size;
+// Options can also come from a file, one per line without the leading dashes
+// ("memory 256G", "page-size 4096"), with '#' starting a comment. They are
+// spliced into the command line in place of --config <file>, so later options
+// still override them.
+char **expandConfig(int *argc, char **argv, int at) {
+    FILE *file = fopen(argv[at + 1], "r");
+    if (!file) {
+        printf("Error opening file %s!\n", argv[at + 1]);
+        return NULL;
+    }
+    int capacity = *argc + 16, count = 0;
+    char **args = malloc(capacity * sizeof(char *));
+    bool ok = args != NULL;
+    for (int i = 0; ok && i < at; i++) args[count++] = argv[i];
+    char line[512];
+    while (ok && fgets(line, sizeof(line), file)) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+        bool first = true;
+        for (char *token = strtok(line, " \t\r\n="); token; token = strtok(NULL, " \t\r\n=")) {
+            if (count + 1 >= capacity) {
+                char **grown = realloc(args, capacity * 2 * sizeof(char *));
+                if (!grown) {
+                    ok = false;
+                    break;
                 }
+                args = grown;
+                capacity *= 2;
+            }
+            char *arg = first ? malloc(strlen(token) + 3) : strdup(token);
+            if (!arg) {
+                ok = false;
+                break;
             }
+            if (first) sprintf(arg, "--%s", token);
+            args[count++] = arg;
+            first = false;
         }
-
-        float fragmentation = (freeMemory > 0) ? 
-                            (fragmentedSize / (float)freeMemory) * 100 : 0;
-        float successRate = managers[i].totalRequests > 0 
-                           ? (managers[i].successfulAllocations / (float)managers[i].totalRequests) * 100 
-                           : 0;
-
-        printf("%-18s  %6d    %6d    %6.1f%%       %5.1f%%\n", 
-               algorithmNames[i], allocated, freeMemory, fragmentation, successRate);
     }
-
-    int allocatedFrames = 0;
-    int totalFrames = MEMORY_SIZE/PAGE_SIZE;
-    for (int i = 0; i < totalFrames; i++) {
-        if (pageFrames[i] != -1) {
-            allocatedFrames++;
-        }
+    fclose(file);
+    int rest = *argc - at - 2;
+    if (ok && count + rest > capacity) {
+        char **grown = realloc(args, (count + rest) * sizeof(char *));
+        if (grown) args = grown; else ok = false;
     }
-    printf("%-18s  %6d    %6d    %6.1f%%       %5.1f%%\n",
-           "Paging", 
-           allocatedFrames*PAGE_SIZE,
-           (totalFrames-allocatedFrames)*PAGE_SIZE,
-           0.0,
-           100.0);
-
-    int segmentAllocated = 0, segmentFree = 0, segmentFragments = 0;
-    for (int j = 0; j < managers[0].totalBlocks; j++) {
-        if (managers[0].memory[j].allocated) {
-            segmentAllocated += managers[0].memory[j].size;
-        } else {
-            segmentFree += managers[0].memory[j].size;
-            if (managers[0].memory[j].size <= FRAG_THRESHOLD) {
-                segmentFragments++;
-            }
-        }
+    if (!ok) {
+        printf("Out of memory reading %s!\n", argv[at + 1]);
+        for (int i = at; args && i < count; i++) free(args[i]);
+        free(args);
+        return NULL;
     }
-    float segmentFragmentation = (segmentFree > 0) ? 
-                           (segmentFragments * FRAG_THRESHOLD / (float)segmentFree) * 100 : 0;
-    float segmentSuccessRate = managers[0].totalRequests > 0 
-                         ? (managers[0].successfulAllocations / (float)managers[0].totalRequests) * 100 
-                         : 0;
-    printf("%-18s  %6d    %6d    %6.1f%%       %5.1f%%\n",
-           "Segmentation",
-           segmentAllocated, segmentFree, segmentFragmentation, segmentSuccessRate);
+    for (int i = at + 2; i < *argc; i++) {
+        args[count++] = argv[i];
+    }
+    *argc = count;
+    return args;
+}
+
+void printUsage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  (no options)           interactive menus\n");
+    printf("  --replay <trace>       replay a text or binary trace, then save statistics\n");
+    printf("  --convert <in> <out>   convert a trace to the binary format\n");
+    printf("  --generate <events>    synthesize a workload (suffixes as for --memory) and replay it\n");
+    printf("  --gen-output <file>    write the generated workload as a binary trace instead\n");
+    printf("  --gen-seed <n>         generator seed (default 1)\n");
+    printf("  --gen-sizes <dist>     uniform, bimodal, powerlaw or malloc (default)\n");
+    printf("  --gen-lifetime <dist>  object lifetimes: exp (default) or pareto\n");
+    printf("  --gen-mean-life <n>    mean object lifetime in allocations (default: %.0f%% of memory live)\n",
+           GEN_TARGET_LOAD * 100);
+    printf("  --gen-phase <events>   start a phase with rescaled sizes and lifetimes every n events\n");
+    printf("  --gen-processes <r>    process arrivals per 1000 allocations (default 0.5)\n");
+    printf("  --gen-process-life <n>  mean process lifetime in allocations (default 20000)\n");
+    printf("  --verbose              print every operation during replay\n");
+    printf("  --restore <snapshot>   start from a saved state (its settings replace the options)\n");
+    printf("  --snapshot <file>      save the whole state after the replay or on exit\n");
+    printf("  --config <file>        read options from a file, one per line without the dashes\n");
+    printf("  --memory <units>       size of every arena and of physical memory, with an optional\n");
+    printf("                         K, M, G or T suffix (default 1000)\n");
+    printf("  --processes <n>        process table size for paging and segmentation, suffixes as\n");
+    printf("                         for --memory (default 10)\n");
+    printf("  --frag-threshold <units>  free blocks up to this size count as fragments (default 5)\n");
+    printf("  --align <units>        default alignment of block requests, a power of two (default 1)\n");
+    printf("  --size-classes <n,n,...>  round block requests up to the first class that holds them,\n");
+    printf("                         larger ones to a multiple of the last (default exact sizes)\n");
+    printf("  --no-index             use linear fit scans instead of the free-block index\n");
+    printf("  --contiguous-pages     give each paging request one run of frames when possible\n");
+    printf("  --page-size <units>    paging page size, suffixes as for --memory (default 50)\n");
+    printf("  --pt-levels <2-4>      page-table levels (default 2)\n");
+    printf("  --pt-bits <n>          index bits per page-table level (default 4)\n");
+    printf("  --tlb <sets>x<ways>    TLB geometry (default 4x4)\n");
+    printf("  --huge-pages <mode>    never (default), always (map huge pages at allocation) or\n");
+    printf("                         defer (only promote filled ranges later)\n");
+    printf("  --huge-level <n>       largest page-table level mapping a huge page (default 1)\n");
+    printf("  --numa <nodes>         also replay on per-node arenas (up to %d) for every fit policy\n", MAX_NUMA_NODES);
+    printf("  --numa-policy <p>      local (default), interleave or preferred[:node]\n");
+    printf("  --numa-distance <d,...>  remote distance (default 20, local is 10) or a full\n");
+    printf("                         row-major nodes x nodes distance matrix\n");
+    printf("  --demand-paging [policy]  fault pages in on translation, evicting with\n");
+    printf("                         fifo, lru (default), clock, arc or 2q\n");
+    printf("  --swap-pages <n>       swap device size in pages (default 4x the frames)\n");
+    printf("  --segment-policy <1-%d>  fit policy placing segments (default 1)\n", ALGORITHMS);
+    printf("  --paged-segments       back each segment with its own page table over the frame pool\n");
+    printf("  --sample-every <ops>   during replay, sample the statistics every n operations\n");
+    printf("  --sample-ms <ms>       ... and/or every n milliseconds\n");
+    printf("  --metrics <file>       time series output (default memory_timeseries.csv)\n");
+    printf("  --compact <mode>       compact on allocation failure: full, incremental or\n");
+    printf("                         a byte budget per step (not used by --concurrent)\n");
+    printf("  --compact-threshold <%%>  also compact after frees above this fragmentation\n");
+    printf("  --concurrent <trace>   replay a trace on worker threads against one shared arena,\n");
+    printf("                         comparing a global lock with per-thread caches\n");
+    printf("  --threads <n,n,...>    thread counts for --concurrent (default 1,2,4,... up to cores);\n");
+    printf("                         the first one sizes the --sweep pool (default all cores)\n");
+    printf("  --algorithm <1-%d>      fit policy of the shared arena (default 1)\n", ALGORITHMS);
+    printf("  --bench [output.csv]   run the benchmark workloads on every algorithm\n");
+    printf("                         (results default to bench_results.csv)\n");
+    printf("  --dispatch-bench [output.csv]  time the bench workloads through the fit function\n");
+    printf("                         pointer and the specialized allocators (dispatch_results.csv)\n");
+    printf("  --arena <units>        arena size for --concurrent (default %d) and --bench (default %d)\n",
+           CONCURRENT_ARENA_SIZE, BENCH_ARENA_SIZE);
+    printf("  --sweep [output.csv]   run every workload x policy x arena size in parallel\n");
+    printf("                         (results default to sweep_results.csv)\n");
+    printf("  --sweep-arenas <n,n,...>  arena sizes for --sweep (default 65536,262144,1048576,%d)\n",
+           BENCH_ARENA_SIZE);
 }
 
 void printMainMenu() {
@@ -438,6 +5593,7 @@ void printDynamicPartitionMenu() {
     printf("4. Deallocate memory (specific algorithm)\n");
     printf("5. Display memory state\n");
     printf("6. Back to main menu\n");
+    printf("7. Compact memory (all algorithms)\n");
     printf("Choose option: ");
 }
 
@@ -457,27 +5613,415 @@ void printPagingMenu() {
     printf("4. Display page table\n");
     printf("5. Display frame allocation\n");
     printf("6. Back to main menu\n");
+    printf("7. Translate virtual address\n");
     printf("Choose option: ");
 }
 
 void printSegmentationMenu() {
     printf("\nSegmentation System\n");
     printf("1. Create new process\n");
-    printf("2. Allocate segment to process\n");
+    printf("2. Allocate or grow segment\n");
     printf("3. Deallocate process segments\n");
-    printf("4. Display segments\n");
+    printf("4. Display segment table\n");
     printf("5. Back to main menu\n");
+    printf("6. Translate segment offset\n");
     printf("Choose option: ");
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    const char *replayPath = NULL;
+    const char *concurrentPath = NULL;
+    bool replayVerbose = false;
+    int threadCounts[MAX_THREAD_COUNTS];
+    int threadRuns = 0;
+    int concurrentAlgorithm = 0;
+    long arenaSize = 0;
+    const char *benchPath = NULL;
+    const char *sweepPath = NULL;
+    const char *dispatchPath = NULL;
+    const char *snapshotPath = NULL;
+    const char *restorePath = NULL;
+    long sweepArenas[MAX_SWEEP_ARENAS] = {1 << 16, 1 << 18, 1 << 20, BENCH_ARENA_SIZE};
+    int sweepArenaCount = 4;
+    int distances[MAX_NUMA_NODES * MAX_NUMA_NODES];
+    int distanceCount = 0;
+    GeneratorConfig generator = {0, 1, SIZES_MALLOC, LIFETIME_EXPONENTIAL, 0, 0, 0.5 / 1000, 20000};
+    const char *generatorPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            argv = expandConfig(&argc, argv, i);
+            if (!argv) return 1;
+            i--;
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            memorySize = parseSize(argv[++i]);
+            if (memorySize <= 0) {
+                printf("Invalid memory size!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            long processes = parseSize(argv[++i]);
+            if (processes < 2 || processes > INT_MAX) {
+                printf("Invalid process count! Must be 2-%d\n", INT_MAX);
+                return 1;
+            }
+            maxProcesses = (int)processes;
+        } else if (strcmp(argv[i], "--frag-threshold") == 0 && i + 1 < argc) {
+            long threshold = parseSizeOrZero(argv[++i]);
+            if (threshold < 0 || threshold > INT_MAX) {
+                printf("Invalid fragmentation threshold! Must be 0-%d\n", INT_MAX);
+                return 1;
+            }
+            fragThreshold = (int)threshold;
+        } else if (strcmp(argv[i], "--align") == 0 && i + 1 < argc) {
+            requestAlignment = parseSize(argv[++i]);
+            if (requestAlignment <= 0 || (requestAlignment & (requestAlignment - 1))) {
+                printf("Invalid alignment! Must be a power of two\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--size-classes") == 0 && i + 1 < argc) {
+            sizeClassCount = 0;
+            for (char *p = argv[++i]; *p && sizeClassCount < MAX_SIZE_CLASS_TABLE; ) {
+                long size = strtol(p, &p, 10);
+                if (size <= 0 || (sizeClassCount && size <= sizeClassTable[sizeClassCount - 1])) {
+                    printf("Invalid size classes! Use ascending positive sizes\n");
+                    return 1;
+                }
+                sizeClassTable[sizeClassCount++] = size;
+                if (*p) p++;
+            }
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            benchPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "bench_results.csv";
+        } else if (strcmp(argv[i], "--dispatch-bench") == 0) {
+            dispatchPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "dispatch_results.csv";
+        } else if (strcmp(argv[i], "--sweep") == 0) {
+            sweepPath = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : "sweep_results.csv";
+        } else if (strcmp(argv[i], "--sweep-arenas") == 0 && i + 1 < argc) {
+            sweepArenaCount = 0;
+            for (char *p = argv[++i]; *p && sweepArenaCount < MAX_SWEEP_ARENAS; ) {
+                long size = strtol(p, &p, 10);
+                if (size > 0) sweepArenas[sweepArenaCount++] = size;
+                if (*p) p++;
+            }
+            if (sweepArenaCount == 0) {
+                printf("Invalid arena size!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--concurrent") == 0 && i + 1 < argc) {
+            concurrentPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            for (char *p = argv[++i]; *p && threadRuns < MAX_THREAD_COUNTS; ) {
+                int threads = (int)strtol(p, &p, 10);
+                if (threads > 0) threadCounts[threadRuns++] = threads;
+                if (*p) p++;
+            }
+        } else if (strcmp(argv[i], "--algorithm") == 0 && i + 1 < argc) {
+            concurrentAlgorithm = atoi(argv[++i]) - 1;
+            if (concurrentAlgorithm < 0 || concurrentAlgorithm >= ALGORITHMS) {
+                printf("Invalid algorithm! Must be 1-%d\n", ALGORITHMS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+            arenaSize = parseSize(argv[++i]);
+            if (arenaSize <= 0) {
+                printf("Invalid arena size!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            restorePath = argv[++i];
+        } else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) {
+            generator.events = parseSize(argv[++i]);
+            if (generator.events <= 0) {
+                printf("Invalid event count!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--gen-output") == 0 && i + 1 < argc) {
+            generatorPath = argv[++i];
+        } else if (strcmp(argv[i], "--gen-seed") == 0 && i + 1 < argc) {
+            generator.seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gen-sizes") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            int sizes = 0;
+            while (sizes < SIZE_DISTRIBUTIONS && strcasecmp(name, sizeDistributionNames[sizes]) != 0) sizes++;
+            if (sizes == SIZE_DISTRIBUTIONS) {
+                printf("Invalid size distribution! Use uniform, bimodal, powerlaw or malloc\n");
+                return 1;
+            }
+            generator.sizes = sizes;
+        } else if (strcmp(argv[i], "--gen-lifetime") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            int lifetimes = 0;
+            while (lifetimes < LIFETIME_DISTRIBUTIONS && strcasecmp(name, lifetimeNames[lifetimes]) != 0) lifetimes++;
+            if (lifetimes == LIFETIME_DISTRIBUTIONS) {
+                printf("Invalid lifetime distribution! Use exp or pareto\n");
+                return 1;
+            }
+            generator.lifetimes = lifetimes;
+        } else if (strcmp(argv[i], "--gen-mean-life") == 0 && i + 1 < argc) {
+            generator.meanLifetime = atof(argv[++i]);
+            if (generator.meanLifetime <= 0) {
+                printf("Invalid mean lifetime!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--gen-phase") == 0 && i + 1 < argc) {
+            generator.phaseLength = parseSize(argv[++i]);
+            if (generator.phaseLength <= 0) {
+                printf("Invalid phase length!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--gen-processes") == 0 && i + 1 < argc) {
+            generator.processRate = atof(argv[++i]) / 1000;
+            if (generator.processRate < 0 || generator.processRate > 1) {
+                printf("Invalid process arrival rate! Must be 0-1000\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--gen-process-life") == 0 && i + 1 < argc) {
+            generator.processLifetime = atof(argv[++i]);
+            if (generator.processLifetime <= 0) {
+                printf("Invalid process lifetime!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--convert") == 0 && i + 2 < argc) {
+            return convertTrace(argv[i + 1], argv[i + 2]) ? 0 : 1;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            replayVerbose = true;
+        } else if (strcmp(argv[i], "--no-index") == 0) {
+            useFreeIndex = false;
+        } else if (strcmp(argv[i], "--contiguous-pages") == 0) {
+            contiguousPages = true;
+        } else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+            long size = parseSize(argv[++i]);
+            pageSize = size > INT_MAX ? -1 : (int)size; // Rejected with the other page-size checks below
+        } else if (strcmp(argv[i], "--pt-levels") == 0 && i + 1 < argc) {
+            pageTableLevels = atoi(argv[++i]);
+            if (pageTableLevels < 2 || pageTableLevels > 4) {
+                printf("Invalid page-table levels! Must be 2-4\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--pt-bits") == 0 && i + 1 < argc) {
+            pageTableBits = atoi(argv[++i]);
+            if (pageTableBits < 1 || pageTableBits > 10) {
+                printf("Invalid page-table bits! Must be 1-10\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--demand-paging") == 0) {
+            demandPaging = true;
+            pagingPolicy.policy = POLICY_LRU;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                const char *name = argv[++i];
+                int policy = 0;
+                while (policy < POLICY_OPT && strcasecmp(name, replacementNames[policy]) != 0) policy++;
+                if (policy == POLICY_OPT) {
+                    printf("Invalid replacement policy! Use fifo, lru, clock, arc or 2q\n");
+                    return 1;
+                }
+                pagingPolicy.policy = policy;
+            }
+        } else if (strcmp(argv[i], "--sample-every") == 0 && i + 1 < argc) {
+            sampleEvery = atol(argv[++i]);
+            if (sampleEvery <= 0) {
+                printf("Invalid sample interval!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sample-ms") == 0 && i + 1 < argc) {
+            sampleMillis = atol(argv[++i]);
+            if (sampleMillis <= 0) {
+                printf("Invalid sample interval!\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (strcmp(argv[i], "--paged-segments") == 0) {
+            pagedSegments = true;
+        } else if (strcmp(argv[i], "--segment-policy") == 0 && i + 1 < argc) {
+            segmentPolicy = atoi(argv[++i]) - 1;
+            if (segmentPolicy < 0 || segmentPolicy >= ALGORITHMS) {
+                printf("Invalid algorithm! Must be 1-%d\n", ALGORITHMS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--compact") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "full") == 0) {
+                compactionMode = COMPACT_FULL;
+            } else if (strcmp(mode, "incremental") == 0) {
+                compactionMode = COMPACT_INCREMENTAL;
+            } else if ((compactionBudget = atol(mode)) > 0) {
+                compactionMode = COMPACT_BUDGETED;
+            } else {
+                printf("Invalid compaction mode! Use full, incremental or a byte budget\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--compact-threshold") == 0 && i + 1 < argc) {
+            compactionThreshold = atof(argv[++i]);
+            if (compactionThreshold <= 0 || compactionThreshold > 100) {
+                printf("Invalid compaction threshold! Must be 0-100\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--swap-pages") == 0 && i + 1 < argc) {
+            long pages = parseSize(argv[++i]);
+            if (pages <= 0 || pages > INT_MAX) {
+                printf("Invalid swap size! Must be 1-%d pages\n", INT_MAX);
+                return 1;
+            }
+            swapPages = (int)pages;
+        } else if (strcmp(argv[i], "--huge-pages") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            int m = 0;
+            while (m <= HUGE_DEFER && strcmp(mode, hugePageModeNames[m]) != 0) m++;
+            if (m > HUGE_DEFER) {
+                printf("Invalid huge page mode! Use never, always or defer\n");
+                return 1;
+            }
+            hugePageMode = m;
+        } else if (strcmp(argv[i], "--huge-level") == 0 && i + 1 < argc) {
+            hugePageLevel = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--numa") == 0 && i + 1 < argc) {
+            long nodes = parseSize(argv[++i]);
+            if (nodes < 1 || nodes > MAX_NUMA_NODES) {
+                printf("Invalid NUMA node count! Must be 1-%d\n", MAX_NUMA_NODES);
+                return 1;
+            }
+            numaNodes = (int)nodes;
+        } else if (strcmp(argv[i], "--numa-policy") == 0 && i + 1 < argc) {
+            const char *policy = argv[++i];
+            if (strcmp(policy, "local") == 0) {
+                numaPolicy = NUMA_LOCAL;
+            } else if (strcmp(policy, "interleave") == 0) {
+                numaPolicy = NUMA_INTERLEAVE;
+            } else if (strncmp(policy, "preferred", 9) == 0 && (policy[9] == '\0' || policy[9] == ':')) {
+                numaPolicy = NUMA_PREFERRED;
+                numaPreferredNode = policy[9] ? atoi(policy + 10) : 0;
+            } else {
+                printf("Invalid NUMA policy! Use local, interleave or preferred[:node]\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--numa-distance") == 0 && i + 1 < argc) {
+            distanceCount = 0;
+            for (char *p = argv[++i]; *p && distanceCount < MAX_NUMA_NODES * MAX_NUMA_NODES; ) {
+                distances[distanceCount++] = (int)strtol(p, &p, 10);
+                if (*p) p++;
+            }
+        } else if (strcmp(argv[i], "--tlb") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &tlbSets, &tlbWays) != 2 || tlbSets <= 0 || tlbWays <= 0) {
+                printf("Invalid TLB geometry! Use <sets>x<ways>\n");
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (pageSize <= 0 || pageSize > memorySize) {
+        printf("Invalid page size! Must be 1-%ld\n", memorySize);
+        return 1;
+    }
+    if (requestAlignment > memorySize) {
+        printf("Invalid alignment! Must be at most %ld\n", memorySize);
+        return 1;
+    }
+    if (memorySize / pageSize > INT_MAX) {
+        printf("Too many frames! Use a page size of at least %ld\n", memorySize / INT_MAX + 1);
+        return 1;
+    }
+
+    if (hugePageMode != HUGE_NEVER) {
+        if (demandPaging) {
+            printf("Huge pages cannot be combined with --demand-paging\n");
+            return 1;
+        }
+        if (hugePageLevel < 1 || hugePageLevel >= pageTableLevels) {
+            printf("Invalid huge page level! Must be 1-%d\n", pageTableLevels - 1);
+            return 1;
+        }
+    }
+
+    int remoteDistance = 2 * NUMA_LOCAL_DISTANCE;
+    if (numaNodes) {
+        if (numaPreferredNode < 0 || numaPreferredNode >= numaNodes) {
+            printf("Invalid preferred node! Must be 0-%d\n", numaNodes - 1);
+            return 1;
+        }
+        if (distanceCount == 1) {
+            remoteDistance = distances[0];
+        } else if (distanceCount == numaNodes * numaNodes) {
+            for (int d = 0; d < distanceCount; d++) {
+                numaDistance[d / numaNodes][d % numaNodes] = distances[d];
+            }
+        } else if (distanceCount) {
+            printf("Invalid NUMA distances! Give one remote distance or %d values\n", numaNodes * numaNodes);
+            return 1;
+        }
+        for (int d = 0; d < distanceCount; d++) {
+            if (distances[d] <= 0) {
+                printf("Invalid NUMA distances! Must be positive\n");
+                return 1;
+            }
+        }
+        if (snapshotPath || restorePath) {
+            printf("NUMA arenas are not part of snapshots; drop --numa or --snapshot/--restore\n");
+            return 1;
+        }
+    }
+
     // Initialize all managers
+    bool initialized = true;
     for (int i = 0; i < ALGORITHMS; i++) {
-        initializeMemory(&managers[i]);
+        initialized = initializeMemory(&managers[i], i) && initialized;
+    }
+    if (!initialized || !initializeNuma(remoteDistance) || !initializeProcesses() || !initializePaging()
+        || !initializeSegmentation()) {
+        printf("Out of memory initializing the simulator for %d processes and %ld units of memory!\n",
+               maxProcesses, memorySize);
+        return 1;
+    }
+    if (restorePath && !restoreSnapshot(restorePath)) return 1;
+
+    if (concurrentPath) {
+        verbose = false;
+        if (threadRuns == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int threads = 1; threadRuns < MAX_THREAD_COUNTS; threads *= 2) {
+                threadCounts[threadRuns++] = threads < cores ? threads : (int)cores;
+                if (threads >= cores) break;
+            }
+        }
+        return concurrentBenchmark(concurrentPath, threadCounts, threadRuns, concurrentAlgorithm,
+                                   arenaSize ? arenaSize : CONCURRENT_ARENA_SIZE) ? 0 : 1;
+    }
+    if (sweepPath) {
+        verbose = false;
+        int threads = threadRuns ? threadCounts[0] : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        return runSweep(sweepPath, sweepArenas, sweepArenaCount, threads > 0 ? threads : 1) ? 0 : 1;
+    }
+    if (dispatchPath) {
+        verbose = false;
+        return runDispatchBenchmark(dispatchPath, arenaSize ? arenaSize : BENCH_ARENA_SIZE) ? 0 : 1;
+    }
+    if (benchPath) {
+        verbose = false;
+        return runBenchmarks(benchPath, arenaSize ? arenaSize : BENCH_ARENA_SIZE) ? 0 : 1;
+    }
+    if (generator.events && generatorPath) {
+        return generateTrace(&generator, generatorPath) ? 0 : 1;
+    }
+    if (replayPath || generator.events) {
+        verbose = replayVerbose;
+        if (!startMetrics()) return 1;
+        if (replayPath && !replayTrace(replayPath)) return 1;
+        if (generator.events && !generateTrace(&generator, NULL)) return 1;
+        stopMetrics();
+        showCurrentStats();
+        saveStatistics();
+        if (snapshotPath && !saveSnapshot(snapshotPath)) return 1;
+        return 0;
     }
-    initializePaging();
     
-    int mainChoice, subChoice, algoChoice, size, processID;
+    int mainChoice, subChoice, algoChoice, processID, segment;
+    long size;
     while (1) {
         printMainMenu();
         scanf("%d", &mainChoice);
@@ -495,18 +6039,13 @@ int main() {
                             printf("Enter process ID: ");
                             scanf("%d", &processID);
                             printf("Enter size to allocate: ");
-                            scanf("%d", &size);
-                            if (size <= 0 || size > MEMORY_SIZE) {
-                                printf("Invalid size! Must be 1-%d\n", MEMORY_SIZE);
+                            scanf("%ld", &size);
+                            if (size <= 0 || size > memorySize) {
+                                printf("Invalid size! Must be 1-%ld\n", memorySize);
                                 break;
                             }
                             for (int i = 0; i < ALGORITHMS; i++) {
-                                switch (i) {
-                                    case 0: allocate(&managers[i], size, firstFit, algorithmNames[i], processID); break;
-                                    case 1: allocate(&managers[i], size, bestFit, algorithmNames[i], processID); break;
-                                    case 2: allocate(&managers[i], size, worstFit, algorithmNames[i], processID); break;
-                                    case 3: allocate(&managers[i], size, nextFit, algorithmNames[i], processID); break;
-                                }
+                                allocateBlock(&managers[i], size, algorithmNames[i], processID);
                             }
                             break;
                             
@@ -520,17 +6059,12 @@ int main() {
                             printf("Enter process ID: ");
                             scanf("%d", &processID);
                             printf("Enter size to allocate: ");
-                            scanf("%d", &size);
-                            if (size <= 0 || size > MEMORY_SIZE) {
-                                printf("Invalid size! Must be 1-%d\n", MEMORY_SIZE);
+                            scanf("%ld", &size);
+                            if (size <= 0 || size > memorySize) {
+                                printf("Invalid size! Must be 1-%ld\n", memorySize);
                                 break;
                             }
-                            switch (algoChoice-1) {
-                                case 0: allocate(&managers[0], size, firstFit, algorithmNames[0], processID); break;
-                                case 1: allocate(&managers[1], size, bestFit, algorithmNames[1], processID); break;
-                                case 2: allocate(&managers[2], size, worstFit, algorithmNames[2], processID); break;
-                                case 3: allocate(&managers[3], size, nextFit, algorithmNames[3], processID); break;
-                            }
+                            allocateBlock(&managers[algoChoice-1], size, algorithmNames[algoChoice-1], processID);
                             break;
                             
                         case 3: // Deallocate in all algorithms
@@ -558,6 +6092,14 @@ int main() {
                                 displayMemory(&managers[i], algorithmNames[i]);
                             }
                             break;
+
+                        case 7: // Compact memory
+                            for (int i = 0; i < ALGORITHMS; i++) {
+                                if (i == BUDDY_SYSTEM) continue;
+                                long moved = compactMemory(&managers[i], LONG_MAX, INT_MAX);
+                                printf("  [%s] Moved %ld bytes\n", algorithmNames[i], moved);
+                            }
+                            break;
                             
                         default:
                             printf("Invalid choice!\n");
@@ -574,12 +6116,13 @@ int main() {
                     
                     switch (subChoice) {
                         case 1: // Create new process
-                            if (nextProcessID >= MAX_PROCESSES) {
+                            if (nextProcessID >= maxProcesses) {
                                 printf("Maximum number of processes reached!\n");
                                 break;
                             }
                             processes[nextProcessID].processID = nextProcessID;
                             processes[nextProcessID].size = 0;
+                            processes[nextProcessID].pageCount = 0;
                             printf("Created new process with ID: %d\n", nextProcessID);
                             nextProcessID++;
                             break;
@@ -592,9 +6135,9 @@ int main() {
                                 break;
                             }
                             printf("Enter size to allocate: ");
-                            scanf("%d", &size);
-                            if (size <= 0 || size > MEMORY_SIZE) {
-                                printf("Invalid size! Must be 1-%d\n", MEMORY_SIZE);
+                            scanf("%ld", &size);
+                            if (size <= 0 || size > memorySize) {
+                                printf("Invalid size! Must be 1-%ld\n", memorySize);
                                 break;
                             }
                             allocatePages(processID, size);
@@ -624,6 +6167,25 @@ int main() {
                             displayPagingMemory();
                             break;
                             
+                        case 7: { // Translate virtual address
+                            long vaddr;
+                            printf("Enter process ID: ");
+                            scanf("%d", &processID);
+                            if (processID <= 0 || processID >= nextProcessID) {
+                                printf("Invalid process ID!\n");
+                                break;
+                            }
+                            printf("Enter virtual address: ");
+                            scanf("%ld", &vaddr);
+                            long paddr = translate(processID, vaddr);
+                            if (paddr == -1) {
+                                printf("Address %ld is not mapped for process %d\n", vaddr, processID);
+                            } else {
+                                printf("Virtual %ld -> physical %ld\n", vaddr, paddr);
+                            }
+                            break;
+                        }
+                            
                         default:
                             printf("Invalid choice!\n");
                     }
@@ -639,7 +6201,7 @@ int main() {
                     
                     switch (subChoice) {
                         case 1: // Create new process
-                            if (nextProcessID >= MAX_PROCESSES) {
+                            if (nextProcessID >= maxProcesses) {
                                 printf("Maximum number of processes reached!\n");
                                 break;
                             }
@@ -654,13 +6216,19 @@ int main() {
                                 printf("Invalid process ID!\n");
                                 break;
                             }
+                            printf("Enter segment (1=Code, 2=Data, 3=Stack, 4=Heap): ");
+                            scanf("%d", &segment);
+                            if (segment < 1 || segment > SEGMENT_KINDS) {
+                                printf("Invalid segment!\n");
+                                break;
+                            }
                             printf("Enter size to allocate: ");
-                            scanf("%d", &size);
-                            if (size <= 0 || size > MEMORY_SIZE) {
-                                printf("Invalid size! Must be 1-%d\n", MEMORY_SIZE);
+                            scanf("%ld", &size);
+                            if (size <= 0 || size > memorySize) {
+                                printf("Invalid size! Must be 1-%ld\n", memorySize);
                                 break;
                             }
-                            allocateSegment(processID, size);
+                            allocateSegment(processID, segment - 1, size);
                             break;
                             
                         case 3: // Deallocate segments
@@ -683,6 +6251,32 @@ int main() {
                             displaySegments(processID);
                             break;
                             
+                        case 6: { // Translate segment offset
+                            long offset;
+                            int access;
+                            printf("Enter process ID: ");
+                            scanf("%d", &processID);
+                            if (processID <= 0 || processID >= nextProcessID) {
+                                printf("Invalid process ID!\n");
+                                break;
+                            }
+                            printf("Enter segment (1=Code, 2=Data, 3=Stack, 4=Heap): ");
+                            scanf("%d", &segment);
+                            if (segment < 1 || segment > SEGMENT_KINDS) {
+                                printf("Invalid segment!\n");
+                                break;
+                            }
+                            printf("Enter offset: ");
+                            scanf("%ld", &offset);
+                            printf("Enter access (1=read, 2=write, 4=execute): ");
+                            scanf("%d", &access);
+                            long paddr = translateSegment(processID, segment - 1, offset, access);
+                            if (paddr != -1) {
+                                printf("%s:%ld -> physical %ld\n", segmentNames[segment - 1], offset, paddr);
+                            }
+                            break;
+                        }
+                            
                         default:
                             printf("Invalid choice!\n");
                     }
@@ -699,6 +6293,7 @@ int main() {
                 
             case 6: // Exit
                 saveStatistics();
+                if (snapshotPath) saveSnapshot(snapshotPath);
                 return 0;
                 
             default: